@@ -0,0 +1,56 @@
+function results = benchRirEnumeration(fs, roomScales, T60s, lp_filter)
+%   This function compares the run time of the 'box' and 'sphere' image
+%   enumeration of rir_generator_x_threaded over a range of room sizes and
+%   reverberation times, and checks that both give identical responses.
+%
+%   Inputs
+%   fs          Sampling frequency (default 48000)
+%   roomScales  Scale factors applied to a 5 x 4 x 3 m room (default [0.5 1 2])
+%   T60s        Reverberation times in s (default [0.2 0.5 1])
+%   lp_filter   Low-pass filter the pulses (default false, so the timing
+%               reflects the image enumeration rather than the LPF)
+%
+%   Output
+%   results     Table with one row per room/T60 combination: room volume,
+%               T60, time for 'box', time for 'sphere' and the speedup
+
+if nargin < 1, fs = 48000; end
+if nargin < 2, roomScales = [0.5 1 2]; end
+if nargin < 3, T60s = [0.2 0.5 1]; end
+if nargin < 4, lp_filter = false; end
+
+c = 343;                                            % Sound velocity in m/s
+L0 = [5 4 3];                                       % Reference room in m
+
+results = zeros(numel(roomScales)*numel(T60s), 5);
+row = 0;
+
+for ii = 1:numel(roomScales)
+    L = L0.*roomScales(ii);
+    r = [0.3 0.4 0.5].*L;                           % Receiver and source at fixed
+    s = [0.7 0.6 0.4].*L;                           % relative positions
+
+    for jj = 1:numel(T60s)
+        nsample = round(T60s(jj)*fs);
+        args = {c, fs, r, s, L, T60s(jj), nsample, 'o', -1, [1 1 1], 0, true, lp_filter, 0.008};
+
+        tic;
+        h_box = rir_generator_x_threaded(args{:}, struct('enumeration', 'box'));
+        t_box = toc;
+
+        tic;
+        h_sphere = rir_generator_x_threaded(args{:}, struct('enumeration', 'sphere'));
+        t_sphere = toc;
+
+        if ~isequal(h_box, h_sphere)
+            error('Enumeration modes differ for L = [%g %g %g], T60 = %g', L, T60s(jj));
+        end
+
+        row = row + 1;
+        results(row,:) = [prod(L) T60s(jj) t_box t_sphere t_box/t_sphere];
+        fprintf('V = %7.1f m^3  T60 = %4.2f s  box = %8.3f s  sphere = %8.3f s  speedup = %5.2f\n', ...
+            results(row,:));
+    end
+end
+
+end
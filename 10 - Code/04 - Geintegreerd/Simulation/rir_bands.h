@@ -0,0 +1,114 @@
+/*
+Program     : Room Impulse Response Generator - octave-band reflection coefficients
+
+Description : Frequency-dependent walls for Config::nr_of_bands. The images
+              are enumerated once, with unit wall gains, and every accepted
+              image adds its pulse with the wall gains of each band b to a
+              response x_b of that band, so that the distances, the
+              directivity and the LPF kernel are shared by the bands. The
+              band responses are combined by a zero-phase filterbank of
+              windowed-sinc lowpass filters LP_b at the crossovers between
+              the bands:
+                  h = sum_b (LP_b - LP_{b-1}) * x_b
+                    = x_{B-1} + sum_{b < B-1} LP_b * (x_b - x_{b+1}),
+              with LP_{-1} = 0 and LP_{B-1} a unit pulse. The band filters
+              sum to a unit pulse, so walls that are the same in every band
+              give the broadband response.
+*/
+
+#ifndef RIR_BANDS_H
+#define RIR_BANDS_H
+
+#include "math.h"
+#include "string.h"
+#include "stdint.h"
+#include "rir_simd.h"
+
+struct rir_bands
+{
+	int     nr;             // number of bands B
+	int     half;           // the lowpass filters have 2*half+1 taps
+	double* lowpass;        // the B-1 lowpass filters, crossover after crossover
+	size_t  bytes;          // memory held by the filters
+};
+
+// Frequency in Hz of crossover b, between the bands with centre frequencies
+// fc*2^b and fc*2^(b+1).
+static double rir_bands_crossover(double fc, int b)
+{
+	return fc*pow(2., b)*M_SQRT2;
+}
+
+// Builds the filters for nr bands, the first one centred at fc Hz, at the
+// sampling frequency fs. The Hann window is long enough for a transition
+// band of about half the lowest crossover.
+static void rir_bands_build(struct rir_bands* fb, int nr, double fc, double fs)
+{
+	int taps;
+
+	fb->nr = nr;
+	fb->half = 0;
+	fb->lowpass = NULL;
+	fb->bytes = 0;
+	if (nr < 2)
+		return;
+
+	fb->half = (int) ceil(4*fs/rir_bands_crossover(fc, 0));
+	taps = 2*fb->half + 1;
+	fb->lowpass = new double[(nr-1)*taps];
+	fb->bytes = (nr-1)*taps*sizeof(double);
+
+	for (int b = 0 ; b < nr-1 ; b++)
+	{
+		double* lp = fb->lowpass + b*taps;
+		double  e = rir_bands_crossover(fc, b)/fs;
+		double  sum = 0;
+
+		for (int n = -fb->half ; n <= fb->half ; n++)
+		{
+			double w = 0.5 + 0.5*cos(M_PI*n/(fb->half + 1));
+			lp[n + fb->half] = w*((n == 0) ? 2*e : sin(2*M_PI*e*n)/(M_PI*n));
+			sum += lp[n + fb->half];
+		}
+
+		// Unit gain at DC
+		for (int n = 0 ; n < taps ; n++)
+			lp[n] /= sum;
+	}
+}
+
+static void rir_bands_free(struct rir_bands* fb)
+{
+	delete [] fb->lowpass;
+}
+
+// Adds the combination of the band responses x, nsamples per band and band
+// after band, to h and clears x. The differences are zero until the first
+// image arrives, and those samples are skipped.
+static void rir_bands_combine(const struct rir_bands* fb, double* x, double* h,
+	unsigned int nsamples, rir_accumulate_fn accumulate)
+{
+	int taps = 2*fb->half + 1;
+
+	for (int b = 0 ; b < fb->nr-1 ; b++)
+	{
+		double*       xb = x + (uint64_t)b*nsamples;
+		const double* xn = xb + nsamples;
+		const double* lp = fb->lowpass + b*taps;
+
+		for (unsigned int n = 0 ; n < nsamples ; n++)
+		{
+			double d = xb[n] - xn[n];
+			if (d != 0)
+				rir_add_pulse(h, nsamples, lp, 2*fb->half, n, d, accumulate);
+		}
+		memset(xb, 0, nsamples*sizeof(double));
+	}
+
+	double* xl = x + (uint64_t)(fb->nr-1)*nsamples;
+	for (unsigned int n = 0 ; n < nsamples ; n++)
+		h[n] += xl[n];
+	memset(xl, 0, nsamples*sizeof(double));
+}
+
+#endif
@@ -0,0 +1,107 @@
+/*
+Program     : Room Impulse Response Generator - microphone directivity and orientation
+
+Description : Gains of the receiver for Config::directivity, looked up by
+              bilinear interpolation in a table measured on a uniform grid of
+              azimuths (about the z axis, from the microphone orientation)
+              and polar angles (from the z axis), instead of the analytic
+              patterns of sim_microphone(). The azimuth of an image only
+              depends on its x and y, so its weights are computed once per
+              column of images along z; the polar angle is taken per image.
+
+              With Config::orientation a receiver has its own axes instead:
+              it points along its x axis, and the direction of an image is
+              taken in the coordinates of these axes. Along a column of
+              images this direction is affine in z, so its x and y part is
+              computed once per column.
+*/
+
+#ifndef RIR_DIRECTIVITY_H
+#define RIR_DIRECTIVITY_H
+
+#include "math.h"
+
+struct rir_directivity
+{
+	const double* gain;     // n_el x n_az x nr, stored as in MATLAB
+	int     n_az;           // azimuths 2*pi*a/n_az, a = 0 .. n_az-1
+	int     n_el;           // polar angles pi*e/(n_el-1), e = 0 .. n_el-1
+	int     nr;             // pages of the table: 1, or one per octave band
+};
+
+// Cell and weights of one direction in the table
+struct rir_directivity_at
+{
+	int     a0, a1;         // azimuth columns
+	double  wa;             // weight of a1
+	int     e0;             // polar row, the other one is e0+1
+	double  we;             // weight of e0+1
+};
+
+// Azimuth part for the angle az in rad; the table is periodic in azimuth.
+static void rir_directivity_az(const struct rir_directivity* d, double az, struct rir_directivity_at* at)
+{
+	double t = az/(2*M_PI)*d->n_az;
+
+	t -= floor(t/d->n_az)*d->n_az;
+	at->a0 = (int) t;
+	if (at->a0 >= d->n_az)
+		at->a0 = 0;
+	at->wa = t - at->a0;
+	at->a1 = (at->a0 + 1 < d->n_az) ? at->a0 + 1 : 0;
+}
+
+// Polar part for the cosine c of the angle with the z axis.
+static void rir_directivity_el(const struct rir_directivity* d, double c, struct rir_directivity_at* at)
+{
+	double t = acos((c > 1) ? 1 : (c < -1) ? -1 : c)/M_PI*(d->n_el - 1);
+
+	at->e0 = (int) t;
+	if (at->e0 > d->n_el - 2)
+		at->e0 = d->n_el - 2;
+	at->we = t - at->e0;
+}
+
+// Gain of page p of the table at the direction at.
+static double rir_directivity_gain(const struct rir_directivity* d, const struct rir_directivity_at* at, int p)
+{
+	const double* g = d->gain + (size_t)p*d->n_el*d->n_az;
+	const double* g0 = g + (size_t)at->a0*d->n_el + at->e0;
+	const double* g1 = g + (size_t)at->a1*d->n_el + at->e0;
+
+	return (1 - at->we)*((1 - at->wa)*g0[0] + at->wa*g1[0]) + at->we*((1 - at->wa)*g0[1] + at->wa*g1[1]);
+}
+
+// Axes of a receiver in room coordinates, x (where it points), y and z
+// after each other, for [yaw pitch roll] in rad: the rotation
+// Rz(yaw)*Ry(pitch)*Rx(roll) of the room axes.
+static void rir_axes_ypr(const double* ypr, double* axes)
+{
+	double cy = cos(ypr[0]), sy = sin(ypr[0]);
+	double cp = cos(ypr[1]), sp = sin(ypr[1]);
+	double cr = cos(ypr[2]), sr = sin(ypr[2]);
+
+	axes[0] = cy*cp;            axes[1] = sy*cp;            axes[2] = -sp;
+	axes[3] = cy*sp*sr - sy*cr; axes[4] = sy*sp*sr + cy*cr; axes[5] = cp*sr;
+	axes[6] = cy*sp*cr + sy*sr; axes[7] = sy*sp*cr - cy*sr; axes[8] = cp*cr;
+}
+
+// Axes of a receiver for the rotation quaternion [w x y z], which need not be
+// normalized. Returns 0 for a zero quaternion.
+static int rir_axes_quat(const double* q, double* axes)
+{
+	double n = q[0]*q[0] + q[1]*q[1] + q[2]*q[2] + q[3]*q[3];
+	double w, x, y, z;
+
+	if (n == 0)
+		return 0;
+	n = 1/sqrt(n);
+	w = q[0]*n; x = q[1]*n; y = q[2]*n; z = q[3]*n;
+
+	axes[0] = 1 - 2*(y*y + z*z); axes[1] = 2*(x*y + w*z);     axes[2] = 2*(x*z - w*y);
+	axes[3] = 2*(x*y - w*z);     axes[4] = 1 - 2*(x*x + z*z); axes[5] = 2*(y*z + w*x);
+	axes[6] = 2*(x*z + w*y);     axes[7] = 2*(y*z - w*x);     axes[8] = 1 - 2*(x*x + y*y);
+	return 1;
+}
+
+#endif
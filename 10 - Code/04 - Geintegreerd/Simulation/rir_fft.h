@@ -0,0 +1,157 @@
+/*
+Program     : Room Impulse Response Generator - FFT for the convolution
+
+Description : Real FFT of a power-of-two length n for rir::Convolver: a
+              radix-2 complex FFT of length n/2 on the even and odd samples
+              as real and imaginary parts, split into the n/2+1 bins of the
+              real transform. Spectra are stored as interleaved re, im. The
+              inverse leaves out the factor 1/(n/2), which the convolution
+              puts into the spectra of the responses instead.
+*/
+
+#ifndef RIR_FFT_H
+#define RIR_FFT_H
+
+#include "math.h"
+
+struct rir_fft
+{
+	int     n;              // real length
+	double* twiddle;        // e^(-2 pi i k/n), k = 0 .. n/2-1, interleaved
+	int*    bitrev;         // bit-reversed index of k = 0 .. n/2-1
+};
+
+// Builds the tables for the length n, a power of two of at least 4. They are
+// only read by the transforms, which take a work buffer z of n doubles each,
+// so one rir_fft serves all threads.
+static void rir_fft_build(struct rir_fft* f, int n)
+{
+	int m = n/2;
+	int bits = 0;
+
+	while ((1 << bits) < m)
+		bits++;
+
+	f->n = n;
+	f->twiddle = new double[2*m];
+	f->bitrev = new int[m];
+	for (int k = 0 ; k < m ; k++)
+	{
+		int r = 0;
+		for (int b = 0 ; b < bits ; b++)
+			r |= ((k >> b) & 1) << (bits-1-b);
+		f->bitrev[k] = r;
+		f->twiddle[2*k] = cos(2*M_PI*k/n);
+		f->twiddle[2*k+1] = -sin(2*M_PI*k/n);
+	}
+}
+
+static void rir_fft_free(struct rir_fft* f)
+{
+	delete [] f->twiddle;
+	delete [] f->bitrev;
+}
+
+// In-place complex FFT of length m = n/2 on the bit-reversed z, with the
+// conjugate twiddles for sign = -1. The twiddles of length m are every
+// second one of length n.
+static void rir_fft_complex(const struct rir_fft* f, double* z, double sign)
+{
+	int m = f->n/2;
+
+	for (int len = 2 ; len <= m ; len *= 2)
+	{
+		int step = 2*(m/len);
+
+		for (int i = 0 ; i < m ; i += len)
+			for (int k = 0 ; k < len/2 ; k++)
+			{
+				double  wr = f->twiddle[2*k*step];
+				double  wi = sign*f->twiddle[2*k*step+1];
+				double* a = z + 2*(i+k);
+				double* b = a + len;
+				double  tr = wr*b[0] - wi*b[1];
+				double  ti = wr*b[1] + wi*b[0];
+
+				b[0] = a[0] - tr;
+				b[1] = a[1] - ti;
+				a[0] += tr;
+				a[1] += ti;
+			}
+	}
+}
+
+// X = FFT(x) for the n real samples x, n/2+1 bins. x and X may not overlap z.
+static void rir_fft_forward(const struct rir_fft* f, const double* x, double* X, double* z)
+{
+	int     m = f->n/2;
+
+	for (int k = 0 ; k < m ; k++)
+	{
+		z[2*f->bitrev[k]] = x[2*k];
+		z[2*f->bitrev[k]+1] = x[2*k+1];
+	}
+	rir_fft_complex(f, z, 1);
+
+	// X[k] = E[k] + W^k O[k] with E and O the spectra of the even and odd
+	// samples, E[k] = (Z[k] + conj(Z[m-k]))/2 and O[k] = (Z[k] - conj(Z[m-k]))/2i
+	X[0] = z[0] + z[1];
+	X[1] = 0;
+	X[2*m] = z[0] - z[1];
+	X[2*m+1] = 0;
+	for (int k = 1 ; k < m ; k++)
+	{
+		double er = 0.5*(z[2*k] + z[2*(m-k)]);
+		double ei = 0.5*(z[2*k+1] - z[2*(m-k)+1]);
+		double or_ = 0.5*(z[2*k+1] + z[2*(m-k)+1]);
+		double oi = -0.5*(z[2*k] - z[2*(m-k)]);
+		double wr = f->twiddle[2*k];
+		double wi = f->twiddle[2*k+1];
+
+		X[2*k] = er + wr*or_ - wi*oi;
+		X[2*k+1] = ei + wr*oi + wi*or_;
+	}
+}
+
+// x = n/2 * IFFT(X) for the n/2+1 bins X of a real signal.
+static void rir_fft_inverse(const struct rir_fft* f, const double* X, double* x, double* z)
+{
+	int     m = f->n/2;
+
+	// E[k] = (X[k] + conj(X[m-k]))/2, O[k] = W^-k (X[k] - conj(X[m-k]))/2 and
+	// Z[k] = E[k] + i O[k]
+	for (int k = 0 ; k < m ; k++)
+	{
+		double er = 0.5*(X[2*k] + X[2*(m-k)]);
+		double ei = 0.5*(X[2*k+1] - X[2*(m-k)+1]);
+		double dr = 0.5*(X[2*k] - X[2*(m-k)]);
+		double di = 0.5*(X[2*k+1] + X[2*(m-k)+1]);
+		double wr = f->twiddle[2*k];
+		double wi = -f->twiddle[2*k+1];
+		double or_ = wr*dr - wi*di;
+		double oi = wr*di + wi*dr;
+		int    r = f->bitrev[k];
+
+		z[2*r] = er - oi;
+		z[2*r+1] = ei + or_;
+	}
+	rir_fft_complex(f, z, -1);
+
+	for (int k = 0 ; k < m ; k++)
+	{
+		x[2*k] = z[2*k];
+		x[2*k+1] = z[2*k+1];
+	}
+}
+
+// Y += A.*B over nr_of_bins complex bins.
+static void rir_spectrum_mac(double* Y, const double* A, const double* B, int nr_of_bins)
+{
+	for (int k = 0 ; k < nr_of_bins ; k++)
+	{
+		Y[2*k] += A[2*k]*B[2*k] - A[2*k+1]*B[2*k+1];
+		Y[2*k+1] += A[2*k]*B[2*k+1] + A[2*k+1]*B[2*k];
+	}
+}
+
+#endif
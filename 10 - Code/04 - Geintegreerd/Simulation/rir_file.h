@@ -0,0 +1,119 @@
+/*
+Program     : Room Impulse Response Generator - response files
+
+Description : Output of rir::Generator::compute_file: the responses of a
+              call in a file that is mapped into memory, so that the threads
+              write every response straight into it and a dense grid of
+              receivers does not have to fit in the memory. The kernel writes
+              the finished pages back to the disk while the call goes on.
+
+              Layout, in the byte order of the machine that wrote it:
+                offset  0  char[8]  magic "RIRGEN", 0, 1 (version 1)
+                        8  uint32   size of the header, the offset of the data
+                       12  uint32   bytes per sample, 4 (float32) or 8 (float64)
+                       16  uint64   nsamples
+                       24  uint64   M, receivers
+                       32  uint64   N, sources
+                       40  uint64   K, rooms
+                       48  double   fs in Hz
+                       56  uint32   1 once all responses are written, else 0
+                       60  uint32   0
+                       64  the nsamples x M x N x K responses, first index
+                           fastest as in MATLAB
+              rir_memmap.m opens such a file with memmapfile.
+*/
+
+#ifndef RIR_FILE_H
+#define RIR_FILE_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include "stdint.h"
+#include "string.h"
+#include "unistd.h"
+
+#define RIR_FILE_HEADER 64
+
+struct rir_file_header
+{
+	char     magic[8];
+	uint32_t header_size;
+	uint32_t sample_size;
+	uint64_t nsamples;
+	uint64_t nr_of_mics;
+	uint64_t nr_of_louds;
+	uint64_t nr_of_rooms;
+	double   fs;
+	uint32_t complete;
+	uint32_t reserved;
+};
+
+struct rir_file
+{
+	int      fd;
+	void*    map;
+	uint64_t size;
+	void*    data;          // the responses, RIR_FILE_HEADER bytes into the map
+};
+
+// Creates (or truncates) the file with the header and zero responses and
+// maps it. Returns 0 with errno set when the file cannot be created, its
+// space cannot be reserved or it cannot be mapped.
+static int rir_file_create(struct rir_file* f, const char* path, uint64_t nsamples, uint64_t nr_of_mics,
+	uint64_t nr_of_louds, uint64_t nr_of_rooms, double fs, uint32_t sample_size)
+{
+	struct rir_file_header h;
+
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, "RIRGEN\0\1", 8);
+	h.header_size = RIR_FILE_HEADER;
+	h.sample_size = sample_size;
+	h.nsamples = nsamples;
+	h.nr_of_mics = nr_of_mics;
+	h.nr_of_louds = nr_of_louds;
+	h.nr_of_rooms = nr_of_rooms;
+	h.fs = fs;
+
+	f->map = NULL;
+	f->size = RIR_FILE_HEADER + nsamples*nr_of_mics*nr_of_louds*nr_of_rooms*sample_size;
+	f->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (f->fd < 0)
+		return 0;
+
+	// The file is extended with zeros, which are the responses before the
+	// images are added. Its blocks are reserved on the disk as well: a
+	// sparse file would only run out of space when the threads write into
+	// the map, which the kernel reports with SIGBUS instead of an error.
+	int rc = (ftruncate(f->fd, (off_t)f->size) != 0) ? errno : posix_fallocate(f->fd, 0, (off_t)f->size);
+	if (rc == 0 && (f->map = mmap(NULL, f->size, PROT_READ | PROT_WRITE, MAP_SHARED, f->fd, 0)) == MAP_FAILED)
+		rc = errno;
+	if (rc != 0)
+	{
+		f->map = NULL;
+		close(f->fd);
+		unlink(path);
+		errno = rc;
+		return 0;
+	}
+	memcpy(f->map, &h, sizeof(h));
+	f->data = (char*)f->map + RIR_FILE_HEADER;
+	return 1;
+}
+
+// Marks the file complete when all responses were written, writes it back
+// and unmaps it. Returns 0 when writing back failed.
+static int rir_file_close(struct rir_file* f, int complete)
+{
+	int ok;
+
+	((struct rir_file_header*)f->map)->complete = complete ? 1 : 0;
+	ok = (msync(f->map, f->size, MS_SYNC) == 0);
+	munmap(f->map, f->size);
+	close(f->fd);
+	return ok;
+}
+
+#endif
@@ -0,0 +1,2766 @@
+/*
+Program     : Room Impulse Response Generator
+ 
+Description : Library version of the image-method engine [1,2] used by
+              rir_generator_x.cpp, rir_generator_x_threaded.cpp and
+              rir_generator_cli.cpp; see rir_generator.h for the interface.
+ 
+              [1] J.B. Allen and D.A. Berkley,
+              Image method for efficiently simulating small-room Acoustics,
+              Journal Acoustic Society of America, 65(4), April 1979, p 943.
+ 
+              [2] P.M. Peterson,
+              Simulating the response of multiple microphones to a single
+              acoustic source in a reverberant room, Journal Acoustic
+              Society of America, 80(5), November 1986.
+ 
+Author      : dr.ir. E.A.P. Habets (ehabets@dereverberation.org)
+modified    : dr. Jorge Martinez (J.A.MartinezCastaneda@TuDelft.nl)
+			: dr. Nikolay Gaubitch (N.D.Gaubitch@tudelft.nl)
+
+Original Version   : 1.8.20080713
+Last Modification  : 20140606
+
+History     : 1.0.20030606 Initial version
+              1.1.20040803 + Microphone directivity
+                           + Improved phase accuracy [2]
+              1.2.20040312 + Reflection order
+              1.3.20050930 + Reverberation Time
+              1.4.20051114 + Supports multi-channels
+              1.5.20051116 + High-pass filter [1]
+                           + Microphone directivity control
+              1.6.20060327 + Minor improvements
+              1.7.20060531 + Minor improvements
+              1.8.20080713 + Minor improvements (Compiled using Matlab R2008a)
+Modifications:
+		20080806   + Supports multiple sound sources. Delivers the impulse 
+                     responses in column vectors.
+        20081212   + BUG FIX (Direct Path erasing problem).
+                   + Added option to use either the original version of Allen & Berkley 
+                     or the enhanced LPF-based version from Peterson.
+        20090427   + The LPF hanning window length can be specified.
+                   + The room dimension now can be specified with a 1 X 3 boolean
+                     vector which controls the projection of the space on 
+                     any of the Cartesian coordinates.
+        20130114   + Multithreaded version (PTHREAD based for POSIX systems). 
+                     Individual RIRs are computed in parallel ONE RIR PER AVAILABLE CORE at a time.
+        20140606   + Bug fixes.
+
+                   
+
+Copyright (C) 2003-2008 E.A.P. Habets, The Netherlands.
+ 
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+ 
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+
+#define _USE_MATH_DEFINES
+#include <inttypes.h>
+#include <stdint.h>
+#include "pthread.h"
+#include "unistd.h"
+#include "math.h"
+#include "string.h"
+#include "stdlib.h"
+#include "stdio.h"
+#include "rir_generator.h"
+#include "rir_simd.h"
+#include "rir_image_list.h"
+#include <time.h>
+#include <new>
+#include "rir_lattice.h"
+#include "rir_tail.h"
+#include "rir_bands.h"
+#include "rir_directivity.h"
+#include "rir_fft.h"
+#include "rir_file.h"
+#include "rir_hpf.h"
+#include "rir_numa.h"
+
+#define ROUND(x) ((x)>=0?(long)((x)+0.5):(long)((x)-0.5))
+
+// Work counters and phase timers (rir::Counters), only compiled in with
+// -DRIR_COUNTERS so that the image loops are unchanged otherwise. The timers
+// read the time stamp counter on x86 and the monotonic clock in ns elsewhere.
+// Every task adds its counts to the slot of the thread running it, which is
+// 0 for the calling thread.
+#ifdef RIR_COUNTERS
+#define RIR_COUNT(x) x
+
+static __thread int pool_thread_nr = 0;
+
+static inline uint64_t rir_cycles()
+{
+#ifdef RIR_SIMD_X86
+	return __rdtsc();
+#else
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t)t.tv_sec*1000000000u + (uint64_t)t.tv_nsec;
+#endif
+}
+
+static void rir_counters_add(rir::Counters* a, const rir::Counters& b)
+{
+	a->tasks += b.tasks;
+	a->images_visited += b.images_visited;
+	a->images_rejected_order += b.images_rejected_order;
+	a->images_rejected_distance += b.images_rejected_distance;
+	a->images_accepted += b.images_accepted;
+	a->taps_written += b.taps_written;
+	a->cycles_total += b.cycles_total;
+	a->cycles_images += b.cycles_images;
+	a->cycles_lpf += b.cycles_lpf;
+	a->cycles_scatter += b.cycles_scatter;
+	a->cycles_hp_filter += b.cycles_hp_filter;
+	a->cycles_reduce += b.cycles_reduce;
+	a->cycles_filterbank += b.cycles_filterbank;
+}
+#else
+#define RIR_COUNT(x)
+#endif
+
+// Seconds between two calls of Config::progress
+#define RIR_PROGRESS_INTERVAL 0.1
+
+// Partial responses of an image-parallel call with Config::deterministic,
+// whatever the number of threads
+#define RIR_DETERMINISTIC_PARTS 16
+
+// Image-parallel partial responses start and end on a cache line of their
+// own, so that no two threads write to the same line
+#define RIR_CACHE_LINE 64
+
+// Progress of a call for Config::progress. The tasks count the image slabs
+// (mx) they start per RIR and stop at the next slab once cancel is set; the
+// thread that called compute() sums the fractions and calls the function,
+// from the pool while it waits or from the image loop when it computes alone.
+struct rir_progress
+{
+    int           (*fn)(double, void*);
+    void*         data;
+    uint32_t*     done;         // slabs started per RIR of all rooms
+    uint32_t*     total;        // slabs per RIR, 0 until its first one
+    uint64_t      nr_of_rirs;
+    uint64_t      nr_of_computed;   // RIRs computed by the call
+    int           inline_poll;  // the calling thread runs the tasks
+    int           cancel;
+    double        next;         // time of the next call
+};
+
+static double rir_seconds()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + 1e-9*t.tv_nsec;
+}
+
+// Calls the progress function when it is due; only in the calling thread.
+static void rir_progress_poll(struct rir_progress* pr)
+{
+    double now = rir_seconds();
+    double fraction = 0;
+
+    if (now < pr->next || __atomic_load_n(&pr->cancel, __ATOMIC_RELAXED))
+        return;
+    pr->next = now + RIR_PROGRESS_INTERVAL;
+
+    for (uint64_t i = 0 ; i < pr->nr_of_rirs ; i++)
+    {
+        uint32_t total = __atomic_load_n(&pr->total[i], __ATOMIC_RELAXED);
+        if (total > 0)
+            fraction += (double)__atomic_load_n(&pr->done[i], __ATOMIC_RELAXED)/total;
+    }
+    if (pr->nr_of_computed > 0)
+        fraction /= pr->nr_of_computed;
+    if (pr->fn(fraction, pr->data))
+        __atomic_store_n(&pr->cancel, 1, __ATOMIC_RELAXED);
+}
+
+// Counts a slab of the nr_of_slabs of RIR rir; returns nonzero when the call
+// is cancelled.
+static int rir_progress_slab(struct rir_progress* pr, uint64_t rir, uint32_t nr_of_slabs)
+{
+    __atomic_store_n(&pr->total[rir], nr_of_slabs, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&pr->done[rir], 1, __ATOMIC_RELAXED);
+    if (pr->inline_poll)
+        rir_progress_poll(pr);
+    return __atomic_load_n(&pr->cancel, __ATOMIC_RELAXED);
+}
+
+struct arg_s
+{
+    int tNum;
+    int tTot;
+    
+    const double* ss;
+    const double* rr;
+    
+    
+    double*       L;
+    double*       beta;
+    double**      beta_pow;
+    const struct rir_lattice* lattice;  // for the vectorized path, else NULL
+    double*       hanning_window;
+    double*       lpf_table;
+    double*       imp;
+    float*        imp_f;
+    float*        hanning_window_f;
+    float*        lpf_table_f;
+    struct rir_image_list* lists;   // per RIR for output 'images', else NULL
+    double        fs;
+    double        cTs;
+    double        angle;
+    double        Fc;    
+    char*         mtype;
+    const struct rir_directivity* directivity;  // measured gains instead of mtype, else NULL
+    const double* pattern;       // P and PG of mic_pattern() per receiver (vectorized path)
+    const double* axes;          // x, y and z axes per receiver (Config::orientation), else NULL
+
+    unsigned int  nr_of_louds;
+    unsigned int  nr_of_mics;
+    unsigned int  nsamples;
+    unsigned int  horizon;       // images arriving before this sample are computed
+    
+    int*          dim_s;
+    int           Tw;
+    int           order;
+    int           lp_filter;
+    int           enumeration;
+    int           lpf_oversampling;
+    int           simd;
+    int           single;
+    int           first_touch;   // Config::first_touch: zero the responses before adding images
+
+    // Stochastic tail from sample horizon on (options.transition), else NULL.
+    // The largest mismatch of the tails added by this task is returned.
+    const struct rir_tail* tail;
+    uint64_t      tail_seed;     // of the first RIR of the room
+    double        tail_mismatch;
+
+    // Octave bands (Config::nr_of_bands): the wall gains per band and the
+    // filterbank combining the band responses, else NULL. The lattice then
+    // has unit wall gains.
+    const struct rir_lattice* band_lattice;
+    const struct rir_bands* bands;
+
+    int           image_parallel;
+    double**      parts;
+    float**       parts_f;
+    int           nr_of_parts;
+    // Config::deterministic: the tasks that finished per pair of the sum tree,
+    // at the index of the right part of the pair, else NULL (impMerge)
+    int*          merge_count;
+    // Set when a task cannot allocate its buffers; the others then stop at
+    // their next RIR or slab and execute() throws
+    int*          failed;
+
+    // RIRs loud_nr*nr_of_mics + mic_nr in [rir_lo, rir_hi) are computed by
+    // this task.
+    uint64_t      rir_lo;
+    uint64_t      rir_hi;
+    const unsigned char* changed;  // only the RIRs with changed[rir] != 0 (Session), else NULL
+
+    // Config::progress, with the RIRs of the room from progress_nr on, else NULL
+    struct rir_progress* progress;
+    uint64_t      progress_nr;
+
+    // Per pool thread (RIR_COUNTERS), else NULL
+    rir::Counters* thread_counters;
+};
+
+// One room of a batch: its dimensions in samples, reflection coefficients and
+// gain tables, shared read-only by the tasks computing its RIRs.
+struct room_s
+{
+    unsigned int  nr;
+    const double* ss;
+    const double* rr;
+    double*       imp;
+    float*        imp_f;
+    struct rir_image_list* lists;
+    double        L[3];
+    double        beta[6];
+    double**      beta_pow;
+    struct rir_lattice lattice;
+    struct rir_lattice* band_lattice;
+    struct rir_tail tail;
+    double        cost;
+};
+
+// Everything of a call that does not depend on the positions of the
+// receivers and sources: the settings that follow from the Config, the
+// tables of the rooms and the LPF kernels, and how the work is split over the
+// threads. Generator::run() prepares them for one call, a Session keeps them
+// between its updates.
+struct rir_tables
+{
+	unsigned int  nr_of_rooms;
+	unsigned int  nr_of_mics;
+	unsigned int  nr_of_louds;
+	int           single;
+	int           simd;
+	int           dim_s[3];
+	int           Tw;
+	double        cTs;
+	unsigned int  horizon;
+	int           tail;
+	int           bands;
+	int           numCPU;
+	int           image_parallel;
+	int           nr_of_parts;       // image-parallel partial responses
+	int           nr_of_tasks;
+	char          mtype[2];
+	struct rir_directivity directivity;
+	std::vector<double> pattern;
+	std::vector<double> axes;
+	double*       hanning_window;
+	double*       lpf_table;
+	float*        hanning_window_f;
+	float*        lpf_table_f;
+	struct rir_bands filterbank;
+	struct room_s* rooms;
+	struct room_s** schedule;
+};
+
+static double sinc(double x)
+{
+	if (x == 0)
+		return(1.);
+	else
+		return(sin(x)/x);
+}
+
+// Windowed-sinc LPF kernel (Fc = 1) for the fractional delay frac in single
+// precision. With m = n-Tw/2 an integer, sin(pi*(m-frac)) = -(-1)^m
+// sin(pi*frac), so a single sin() per kernel is needed and the float
+// arguments stay small.
+static void lpf_kernel_f(float* LPI, const float* window, int Tw, double frac)
+{
+	const float f = (float) frac;
+	const float sf = (float) sin(M_PI*f);
+
+	for (int n = 0 ; n < Tw+1 ; n++)
+	{
+		int   m = n-(Tw/2);
+		float x = (float) M_PI*((float) m - f);
+		LPI[n] = window[n] * ((x == 0) ? 1.f : ((m & 1) ? sf : -sf)/x);
+	}
+}
+
+// First-order pattern P + PG*cos(theta) of a microphone type
+static void mic_pattern(char mtype, double* P, double* PG)
+{
+	// Polar Pattern         P       PG
+	// ------------------------------------
+	// Omnidirectional       1       0
+	// Subcardioid           0.75    0.25
+	// Cardioid              0.5     0.5
+	// Hypercardioid         0.25    0.75
+	// Bidirectional         0       1
+
+	switch(mtype)
+	{
+	case 'o':
+		*P = 1;
+		*PG = 0;
+		break;
+	case 's':
+		*P = 0.75;
+		*PG = 0.25;
+		break;
+	case 'c':
+		*P = 0.5;
+		*PG = 0.5;
+		break;
+	case 'h':
+		*P = 0.25;
+		*PG = 0.75;
+		break;
+	case 'b':
+		*P = 0;
+		*PG = 1;
+		break;
+	default:
+		*P = 1;
+		*PG = 0;
+		break;
+	};
+}
+
+static double sim_microphone(double x, double y, double angle, char* mtype)
+{
+	double a, refl_theta, P, PG;
+
+	refl_theta = atan2(y,x) - angle;
+	mic_pattern(mtype[0], &P, &PG);
+
+	a = P + PG * cos(refl_theta);
+
+	return a;
+}
+
+// Restricts the image index range [-n, n] along one axis to the indices m for
+// which c[i] + m*period can lie within a distance sqrt(rad2) of the receiver,
+// for any of the nc offsets c, and for which the number of reflections along
+// that axis does not exceed ord (ord == -1 means no limit). The range is
+// conservative: it may contain images that are rejected later on, but never
+// drops one that contributes to the response.
+static void image_bounds(double rad2, const double* c, int nc, double period, int ord,
+	int n, int* lo, int* hi)
+{
+	double rad = sqrt(rad2);
+	double cmin = c[0];
+	double cmax = c[0];
+
+	for (int i = 1 ; i < nc ; i++)
+	{
+		if (c[i] < cmin)
+			cmin = c[i];
+		if (c[i] > cmax)
+			cmax = c[i];
+	}
+
+	*lo = (int) floor((-rad - cmax)/period);
+	*hi = (int) ceil((rad - cmin)/period);
+
+	// |2m+q| is at least 2m for m >= 0 and -2m-1 for m < 0.
+	if (ord != -1)
+	{
+		if (*lo < -(ord+1)/2)
+			*lo = -(ord+1)/2;
+		if (*hi > ord/2)
+			*hi = ord/2;
+	}
+
+	if (*lo < -n)
+		*lo = -n;
+	if (*hi > n)
+		*hi = n;
+}
+
+// Smallest squared offset c[i] + m*period over the nc offsets c.
+static double min_offset2(const double* c, int nc, double m_period)
+{
+	double d2 = (c[0] + m_period)*(c[0] + m_period);
+
+	for (int i = 1 ; i < nc ; i++)
+	{
+		if ((c[i] + m_period)*(c[i] + m_period) < d2)
+			d2 = (c[i] + m_period)*(c[i] + m_period);
+	}
+
+	return d2;
+}
+
+// Smallest reflection count |2m+i| over the nc image parities i.
+static int min_order(int m, int nc)
+{
+	return (m < 0 && nc > 1) ? -2*m-1 : abs(2*m);
+}
+
+
+// Rough cost of one RIR in a room with dimensions L (in samples): the images
+// that are visited plus, with the LPF, the Tw+1 taps of every image that
+// arrives within nsamples. Those lie in a ball of radius nsamples which holds
+// one image per L[i] along every used axis i. The cost only orders the tasks
+// of a batch, so the reflection order is ignored.
+static double rir_cost(unsigned int nsamples, const double* L, const int* dim_s,
+	int enumeration, int lp_filter, int Tw)
+{
+	const double ball[4] = { 1, 2, M_PI, 4*M_PI/3 };	// volume of the unit d-ball
+	double       box = 1;
+	double       arrive = 1;
+	int          d = 0;
+
+	for (int i = 0 ; i < 3 ; i++)
+	{
+		if (dim_s[i])
+		{
+			box *= 2*(2*ceil(nsamples/(2*L[i])) + 1);
+			arrive *= nsamples/L[i];
+			d++;
+		}
+	}
+	arrive *= ball[d];
+	if (arrive > box)
+		arrive = box;
+
+	return ((enumeration == 1) ? arrive : box) + ((lp_filter == 1) ? (Tw+1)*arrive : 0);
+}
+
+// Orders rooms by decreasing cost, and by number for equal costs.
+static int cmp_room_cost(const void* a, const void* b)
+{
+	const struct room_s* ra = *(const struct room_s* const*)a;
+	const struct room_s* rb = *(const struct room_s* const*)b;
+
+	if (ra->cost != rb->cost)
+		return (ra->cost > rb->cost) ? -1 : 1;
+	return (ra->nr < rb->nr) ? -1 : (ra->nr > rb->nr);
+}
+
+// Adds the image arriving after dist samples with strength str to the
+// response starting at sample offset of the output, through the LPF kernel
+// or to the nearest sample.
+static void add_image(const struct arg_s* args, const struct rir_kernels* kernels, double* LPI,
+	float* LPI_f, uint64_t offset, double dist, double str, rir::Counters* cnt)
+{
+	(void) cnt;                 // only counted with RIR_COUNTERS
+	RIR_COUNT(uint64_t t0);
+	RIR_COUNT(uint64_t t1);
+
+	int fdist = (int) floor(dist);
+
+	RIR_COUNT(t0 = rir_cycles());
+	if (args->lp_filter == 1 && args->single)
+	{
+		if (args->lpf_table_f != NULL)
+		{
+			double       x = (dist-fdist)*args->lpf_oversampling;
+			int          p = (x < args->lpf_oversampling) ? (int) x : args->lpf_oversampling-1;
+			float        w = (float) (x - p);
+			const float* T0 = args->lpf_table_f + p*(args->Tw+1);
+			const float* T1 = T0 + (args->Tw+1);
+			for (int m = 0 ; m < args->Tw+1 ; m++)
+				LPI_f[m] = T0[m] + w*(T1[m] - T0[m]);
+		}
+		else
+		{
+			lpf_kernel_f(LPI_f, args->hanning_window_f, args->Tw, dist-fdist);
+		}
+		RIR_COUNT(t1 = rir_cycles());
+		RIR_COUNT(cnt->cycles_lpf += t1 - t0);
+		RIR_COUNT(cnt->taps_written +=) rir_add_pulse_f(args->imp_f + offset, args->nsamples, LPI_f, args->Tw, fdist, (float) str, kernels->accumulate_f);
+		RIR_COUNT(cnt->cycles_scatter += rir_cycles() - t1);
+	}
+	else if (args->lp_filter == 1)
+	{
+		if (args->lpf_table != NULL)
+		{
+			double       x = (dist-fdist)*args->lpf_oversampling;
+			int          p = (x < args->lpf_oversampling) ? (int) x : args->lpf_oversampling-1;
+			double       w = x - p;
+			const double* T0 = args->lpf_table + p*(args->Tw+1);
+			const double* T1 = T0 + (args->Tw+1);
+			for (int m = 0 ; m < args->Tw+1 ; m++)
+				LPI[m] = T0[m] + w*(T1[m] - T0[m]);
+		}
+		else
+		{
+			for (int m = 0 ; m < args->Tw+1 ; m++)
+				LPI[m] = args->hanning_window[m] * args->Fc * sinc( M_PI*args->Fc*(m-(dist-fdist)-(args->Tw/2)) );
+		}
+		RIR_COUNT(t1 = rir_cycles());
+		RIR_COUNT(cnt->cycles_lpf += t1 - t0);
+		RIR_COUNT(cnt->taps_written +=) rir_add_pulse(args->imp + offset, args->nsamples, LPI, args->Tw, fdist, str, kernels->accumulate);
+		RIR_COUNT(cnt->cycles_scatter += rir_cycles() - t1);
+	}
+	else if (args->single)
+	{
+		args->imp_f[offset + fdist] += (float) str;
+		RIR_COUNT(cnt->taps_written++);
+		RIR_COUNT(cnt->cycles_scatter += rir_cycles() - t0);
+	}
+	else
+	{
+		args->imp[offset + fdist] += str;
+		RIR_COUNT(cnt->taps_written++);
+		RIR_COUNT(cnt->cycles_scatter += rir_cycles() - t0);
+	}
+}
+
+// Adds the image arriving after dist samples with the strength str[b] of
+// every band b to the band responses x, nsamples per band. The LPF kernel is
+// computed once for all bands.
+static void add_image_bands(const struct arg_s* args, const struct rir_kernels* kernels, double* LPI,
+	double* x, double dist, const double* str, rir::Counters* cnt)
+{
+	(void) cnt;                 // only counted with RIR_COUNTERS
+	int fdist = (int) floor(dist);
+	RIR_COUNT(uint64_t t0 = rir_cycles());
+	RIR_COUNT(uint64_t t1);
+
+	if (args->lp_filter == 1)
+	{
+		if (args->lpf_table != NULL)
+		{
+			double       xo = (dist-fdist)*args->lpf_oversampling;
+			int          p = (xo < args->lpf_oversampling) ? (int) xo : args->lpf_oversampling-1;
+			double       w = xo - p;
+			const double* T0 = args->lpf_table + p*(args->Tw+1);
+			const double* T1 = T0 + (args->Tw+1);
+			for (int m = 0 ; m < args->Tw+1 ; m++)
+				LPI[m] = T0[m] + w*(T1[m] - T0[m]);
+		}
+		else
+		{
+			for (int m = 0 ; m < args->Tw+1 ; m++)
+				LPI[m] = args->hanning_window[m] * args->Fc * sinc( M_PI*args->Fc*(m-(dist-fdist)-(args->Tw/2)) );
+		}
+		RIR_COUNT(t1 = rir_cycles());
+		RIR_COUNT(cnt->cycles_lpf += t1 - t0);
+		for (int b = 0 ; b < args->bands->nr ; b++)
+		{
+			RIR_COUNT(cnt->taps_written +=) rir_add_pulse(x + (uint64_t)b*args->nsamples, args->nsamples, LPI, args->Tw,
+				fdist, str[b], kernels->accumulate);
+		}
+		RIR_COUNT(cnt->cycles_scatter += rir_cycles() - t1);
+	}
+	else
+	{
+		for (int b = 0 ; b < args->bands->nr ; b++)
+			x[(uint64_t)b*args->nsamples + fdist] += str[b];
+		RIR_COUNT(cnt->taps_written += args->bands->nr);
+		RIR_COUNT(cnt->cycles_scatter += rir_cycles() - t0);
+	}
+}
+
+// Sums the partial response of a finished image-parallel task into the
+// tree of impReduce as soon as the other half of a pair is there: the
+// second task of a pair adds the right part to the left one, frees it and
+// goes up a level. The sums are those of impReduce, in the same order, but
+// only the parts of running tasks and of pairs waiting for their other
+// half are kept.
+// Allocates the partial response of an image-parallel task, total samples
+// of size bytes, or returns NULL. It is freed with free().
+static void* part_alloc(uint64_t total, size_t size)
+{
+    uint64_t bytes = (total*size + RIR_CACHE_LINE-1)/RIR_CACHE_LINE*RIR_CACHE_LINE;
+    void*    p = NULL;
+
+    if (posix_memalign(&p, RIR_CACHE_LINE, (size_t)bytes) != 0)
+        return NULL;
+    return p;
+}
+
+static void impMerge(struct arg_s* args)
+{
+    uint64_t total = (uint64_t)args->nsamples*(uint64_t)args->nr_of_mics*(uint64_t)args->nr_of_louds;
+    int      p = args->tNum;
+
+    for (int stride = 1 ; stride < args->nr_of_parts ; stride *= 2)
+    {
+        int left = p - p % (2*stride);
+        int right = left + stride;
+
+        if (right < args->nr_of_parts)
+        {
+            if (__atomic_add_fetch(&args->merge_count[right], 1, __ATOMIC_ACQ_REL) == 1)
+                return;
+            if (args->single)
+            {
+                for (uint64_t i = 0 ; i < total ; i++)
+                    args->parts_f[left][i] += args->parts_f[right][i];
+                free(args->parts_f[right]);
+                args->parts_f[right] = NULL;
+            }
+            else
+            {
+                for (uint64_t i = 0 ; i < total ; i++)
+                    args->parts[left][i] += args->parts[right][i];
+                free(args->parts[right]);
+                args->parts[right] = NULL;
+            }
+        }
+        p = left;
+    }
+}
+
+static void *impComp(void *Args)
+{
+    struct arg_s *args = (struct arg_s *)Args;
+    
+    // Temporary variables and constants (image-method)
+    double              r[3];
+	double              s[3];
+    double*             LPI = new double[args->Tw+1];
+    float*              LPI_f = args->single ? new float[args->Tw+1] : NULL;
+    double              hu[6];
+    double              refl[3];
+    double              dist;
+    double              strength;
+    double              cx[2], cy[2], cz[2];
+    double              rad2, rad2_x = 0, rad2_xy;
+    
+    int                 loud_nr;
+    int                 mic_nr;
+    int                 n1,n2,n3;
+    int                 mx,my,mz;
+    int                 mx_lo, mx_hi, my_lo, my_hi, mz_lo, mz_hi;
+    int                 mx_first, mx_step;
+    int                 ord_x = -1, ord_xy;
+    int                 q, j, k;
+    int                 n;
+    int                 fdist;
+    int                 pos;
+    uint64_t  abs_counter;
+    uint64_t  rir;
+
+    // Columns of images along mz for the vectorized path: z offsets per k,
+    // distances and strengths per (q, j, k). The lattice offsets and gains
+    // come from the room's shared tables.
+    struct rir_kernels  kernels;
+    const struct rir_lattice* lat = args->lattice;
+    double*             z_col = NULL;
+    double*             dist_col = NULL;
+    double*             str_col = NULL;
+    double              xy2, gain, str;
+    int                 n_col = 0, nz, col;
+    rir::Counters       cnt = rir::Counters();
+    int                 b;
+
+    // Octave bands: one response per band for the RIR being computed, the
+    // strengths per band of an image and, in single precision, the combined
+    // response before it is added to the output.
+    const struct rir_lattice* bl = args->band_lattice;
+    double*             band_x = NULL;
+    double*             band_str = NULL;
+    double*             band_h = NULL;
+
+    // Measured directivity: the azimuth weights per (q, j) column and the
+    // weights of an image
+    const struct rir_directivity* dir = args->directivity;
+    struct rir_directivity_at dir_col[4];
+    struct rir_directivity_at dir_at;
+
+    // Pattern of the receiver and, with its own axes, the direction of the
+    // (q, j) columns in receiver coordinates without their z part
+    const double*       ax = NULL;
+    const double*       p_xy;
+    double              P = 1, PG = 0;
+    double              proj_col[4][3];
+    double              z;
+    RIR_COUNT(uint64_t t_start = rir_cycles());
+    RIR_COUNT(uint64_t t0 = 0);
+    RIR_COUNT(uint64_t t1 = 0);
+    RIR_COUNT(cnt.tasks = 1);
+
+    if (args->simd != RIR_SIMD_OFF)
+    {
+        rir_kernels_get(args->simd, &kernels);
+        n_col = 2*lat->n[2] + 1;
+        z_col = new double[2*n_col];
+        dist_col = new double[8*n_col];
+        str_col = new double[8*n_col];
+
+        if (args->bands != NULL)
+        {
+            band_x = new (std::nothrow) double[(uint64_t)args->bands->nr*args->nsamples]();
+            band_str = new double[args->bands->nr];
+            if (args->single)
+                band_h = new (std::nothrow) double[args->nsamples]();
+            if (band_x == NULL || (args->single && band_h == NULL))
+                __atomic_store_n(args->failed, 1, __ATOMIC_RELAXED);
+        }
+    }
+    
+    // Image-parallel: the private partial responses are allocated when the
+    // task starts, and zeroed with the output under Config::first_touch by
+    // the thread that adds the images to them. The buffers that grow with the
+    // RIRs are not allocated with a throwing new, as this runs on a pool
+    // thread.
+    if (args->image_parallel && args->tNum > 0)
+    {
+        uint64_t total = (uint64_t)args->nsamples*args->nr_of_mics*args->nr_of_louds;
+        if (args->single)
+            args->imp_f = args->parts_f[args->tNum] = (float*) part_alloc(total, sizeof(float));
+        else
+            args->imp = args->parts[args->tNum] = (double*) part_alloc(total, sizeof(double));
+        if ((args->single && args->imp_f == NULL) || (!args->single && args->imp == NULL))
+            __atomic_store_n(args->failed, 1, __ATOMIC_RELAXED);
+    }
+    if (args->image_parallel && (args->tNum > 0 || args->first_touch) && !__atomic_load_n(args->failed, __ATOMIC_RELAXED))
+    {
+        uint64_t total = (uint64_t)args->nsamples*args->nr_of_mics*args->nr_of_louds;
+        if (args->single)
+            memset(args->imp_f, 0, total*sizeof(float));
+        else
+            memset(args->imp, 0, total*sizeof(double));
+    }
+
+    for (loud_nr = args->rir_lo/args->nr_of_mics; loud_nr < (int)args->nr_of_louds && (uint64_t)loud_nr*args->nr_of_mics < args->rir_hi; loud_nr++ )	
+	{	
+		
+			s[0] = args->ss[loud_nr + 0*args->nr_of_louds] / args->cTs;
+			s[1] = args->ss[loud_nr + 1*args->nr_of_louds] / args->cTs;
+			s[2] = args->ss[loud_nr + 2*args->nr_of_louds] / args->cTs;
+        
+		// Mic-parallel: every task computes one whole RIR. Image-parallel: every
+		// thread computes the mx slabs mx = -n1+tNum, -n1+tNum+tTot, ... of
+		// all RIRs into its own buffer.
+		for (mic_nr = 0; mic_nr < (int)args->nr_of_mics ; mic_nr++)
+		{
+			rir = (uint64_t)loud_nr*args->nr_of_mics + mic_nr;
+			if (rir < args->rir_lo)
+				continue;
+			if (rir >= args->rir_hi)
+				break;
+			if (args->changed != NULL && !args->changed[rir])
+				continue;
+			if (args->first_touch && !args->image_parallel && args->lists == NULL)
+			{
+				abs_counter = (uint64_t)args->nsamples*(uint64_t)mic_nr + (uint64_t)args->nsamples*(uint64_t)args->nr_of_mics*(uint64_t)loud_nr;
+				if (args->single)
+					memset(args->imp_f + abs_counter, 0, args->nsamples*sizeof(float));
+				else
+					memset(args->imp + abs_counter, 0, args->nsamples*sizeof(double));
+			}
+			if (args->progress != NULL && __atomic_load_n(&args->progress->cancel, __ATOMIC_RELAXED))
+				break;
+			if (__atomic_load_n(args->failed, __ATOMIC_RELAXED))
+				break;
+			
+			r[0] = args->rr[mic_nr + 0*args->nr_of_mics] / args->cTs;
+			r[1] = args->rr[mic_nr + 1*args->nr_of_mics] / args->cTs;
+			r[2] = args->rr[mic_nr + 2*args->nr_of_mics] / args->cTs;
+
+			if (args->simd != RIR_SIMD_OFF)
+			{
+				P = args->pattern[2*mic_nr];
+				PG = args->pattern[2*mic_nr + 1];
+				ax = (args->axes != NULL) ? args->axes + 9*mic_nr : NULL;
+			}
+	
+			n1 = ceil(args->horizon/(2*args->L[0]))*args->dim_s[0];
+			n2 = ceil(args->horizon/(2*args->L[1]))*args->dim_s[1];
+			n3 = ceil(args->horizon/(2*args->L[2]))*args->dim_s[2];
+
+			// Image offsets relative to the receiver for each parity q, j, k.
+			for (q = 0 ; q <= 1*args->dim_s[0] ; q++)
+				cx[q] = s[0] - r[0] + 2*q*r[0];
+			for (j = 0 ; j <= 1*args->dim_s[1] ; j++)
+				cy[j] = s[1] - r[1] + 2*j*r[1];
+			for (k = 0 ; k <= 1*args->dim_s[2] ; k++)
+				cz[k] = s[2] - r[2] + 2*k*r[2];
+
+			// Only images inside this sphere can arrive within the horizon. The
+			// extra sample keeps rounding in the bounds from dropping images.
+			rad2 = ((double)args->horizon+1)*((double)args->horizon+1);
+
+			if (args->simd != RIR_SIMD_OFF)
+			{
+				for (k = 0 ; k <= 1*args->dim_s[2] ; k++)
+					for (mz = -n3 ; mz <= n3 ; mz++)
+						z_col[k*n_col + mz+n3] = cz[k] + lat->offset[2][mz+n3];
+			}
+
+			mx_lo = -n1; mx_hi = n1;
+			if (args->enumeration == 1)
+				image_bounds(rad2, cx, 1+args->dim_s[0], 2*args->L[0], args->order, n1, &mx_lo, &mx_hi);
+
+			mx_first = mx_lo;
+			mx_step = 1;
+			if (args->image_parallel)
+			{
+				mx_step = args->tTot;
+				mx_first = mx_lo + ((args->tNum - (mx_lo+n1)) % mx_step + mx_step) % mx_step;
+			}
+	
+			// Generate room impulse response
+			for (mx = mx_first ; mx <= mx_hi ; mx += mx_step)
+			{
+				if (args->progress != NULL &&
+					rir_progress_slab(args->progress, args->progress_nr + rir, mx_hi - mx_lo + 1))
+					break;
+				if (__atomic_load_n(args->failed, __ATOMIC_RELAXED))
+					break;
+
+				hu[0] = 2*mx*args->L[0];
+		
+				my_lo = -n2; my_hi = n2;
+				if (args->enumeration == 1)
+				{
+					rad2_x = rad2 - min_offset2(cx, 1+args->dim_s[0], hu[0]);
+					ord_x = (args->order == -1) ? -1 : args->order - min_order(mx, 1+args->dim_s[0]);
+					if (rad2_x <= 0 || (args->order != -1 && ord_x < 0))
+						continue;
+					image_bounds(rad2_x, cy, 1+args->dim_s[1], 2*args->L[1], ord_x, n2, &my_lo, &my_hi);
+				}
+	
+				for (my = my_lo ; my <= my_hi ; my++)
+				{
+					hu[1] = 2*my*args->L[1];
+
+					mz_lo = -n3; mz_hi = n3;
+					if (args->enumeration == 1)
+					{
+						rad2_xy = rad2_x - min_offset2(cy, 1+args->dim_s[1], hu[1]);
+						ord_xy = (ord_x == -1) ? -1 : ord_x - min_order(my, 1+args->dim_s[1]);
+						if (rad2_xy <= 0 || (args->order != -1 && ord_xy < 0))
+							continue;
+						image_bounds(rad2_xy, cz, 1+args->dim_s[2], 2*args->L[2], ord_xy, n3, &mz_lo, &mz_hi);
+					}
+
+					if (args->simd != RIR_SIMD_OFF)
+					{
+						// Distances and strengths of the whole mz column in vector
+						// lanes; the directivity only depends on x and y and is the
+						// same for the column, unless the receiver has its own axes.
+						// The images are then added in the same order as in the
+						// scalar loop below.
+						nz = mz_hi - mz_lo + 1;
+						if (nz <= 0)
+							continue;
+						RIR_COUNT(t0 = rir_cycles());
+
+						for (q = 0 ; q <= 1*args->dim_s[0] ; q++)
+						{
+							hu[3] = cx[q] + hu[0];
+							refl[0] = lat->refl[0][q][mx+n1];
+
+							for (j = 0 ; j <= 1*args->dim_s[1] ; j++)
+							{
+								hu[4] = cy[j] + hu[1];
+								refl[1] = lat->refl[1][j][my+n2];
+
+								xy2 = hu[3]*hu[3] + hu[4]*hu[4];
+								if (ax != NULL)
+								{
+									for (n = 0 ; n < 3 ; n++)
+										proj_col[q*2+j][n] = ax[3*n]*hu[3] + ax[3*n+1]*hu[4];
+									gain = refl[0]*refl[1];
+								}
+								else if (dir != NULL)
+								{
+									rir_directivity_az(dir, atan2(hu[4], hu[3]) - args->angle, &dir_col[q*2+j]);
+									gain = refl[0]*refl[1];
+								}
+								else
+									gain = (P + PG * cos(atan2(hu[4], hu[3]) - args->angle)) * refl[0]*refl[1];
+
+								for (k = 0 ; k <= 1*args->dim_s[2] ; k++)
+								{
+									col = (q*2+j)*2+k;
+									kernels.images(nz, z_col + k*n_col + mz_lo+n3, lat->refl[2][k] + mz_lo+n3,
+										xy2, gain, args->cTs, dist_col + col*n_col, str_col + col*n_col);
+									RIR_COUNT(cnt.images_visited += nz);
+
+									// The pattern of a receiver with its own axes, on the
+									// cosine of the 3-D direction with its x axis
+									if (ax != NULL && dir == NULL)
+									{
+										const double* zc = z_col + k*n_col + mz_lo+n3;
+										const double* dc = dist_col + col*n_col;
+										double*       sc = str_col + col*n_col;
+										p_xy = proj_col[q*2+j];
+										for (n = 0 ; n < nz ; n++)
+											sc[n] *= P + PG*(p_xy[0] + ax[2]*zc[n])/dc[n];
+									}
+								}
+							}
+						}
+						RIR_COUNT(cnt.cycles_images += rir_cycles() - t0);
+
+						abs_counter = (uint64_t)args->nsamples*(uint64_t)mic_nr + (uint64_t)args->nsamples*(uint64_t)args->nr_of_mics*(uint64_t)loud_nr;
+						for (mz = mz_lo ; mz <= mz_hi ; mz++)
+							for (q = 0 ; q <= 1*args->dim_s[0] ; q++)
+								for (j = 0 ; j <= 1*args->dim_s[1] ; j++)
+									for (k = 0 ; k <= 1*args->dim_s[2] ; k++)
+									{
+										if (!(abs(2*mx+q)+abs(2*my+j)+abs(2*mz+k) <= args->order || args->order == -1))
+										{
+											RIR_COUNT(cnt.images_rejected_order++);
+											continue;
+										}
+
+										col = ((q*2+j)*2+k)*n_col + mz-mz_lo;
+										dist = dist_col[col];
+										fdist = (int) floor(dist);
+										if (fdist >= (int)args->horizon)
+										{
+											RIR_COUNT(cnt.images_rejected_distance++);
+											continue;
+										}
+										RIR_COUNT(cnt.images_accepted++);
+
+										// The directivity of the image from the azimuth of its column and
+										// its own polar angle, per band with octave bands. With the
+										// receiver's own axes the azimuth changes along the column too.
+										str = str_col[col];
+										if (dir != NULL)
+										{
+											z = z_col[k*n_col + mz+n3];
+											if (ax != NULL)
+											{
+												p_xy = proj_col[q*2+j];
+												rir_directivity_az(dir, atan2(p_xy[1] + ax[5]*z, p_xy[0] + ax[2]*z), &dir_at);
+												rir_directivity_el(dir, (p_xy[2] + ax[8]*z)/dist, &dir_at);
+											}
+											else
+											{
+												dir_at = dir_col[q*2+j];
+												rir_directivity_el(dir, z/dist, &dir_at);
+											}
+											if (band_x == NULL || dir->nr == 1)
+												str *= rir_directivity_gain(dir, &dir_at, 0);
+										}
+
+										if (args->lists != NULL)
+										{
+											RIR_COUNT(t0 = rir_cycles());
+											rir_image_list_add(&args->lists[rir], dist, str, mx, q, my, j, mz, k);
+											RIR_COUNT(cnt.cycles_scatter += rir_cycles() - t0);
+										}
+										else if (band_x != NULL)
+										{
+											for (b = 0 ; b < args->bands->nr ; b++)
+											{
+												band_str[b] = str * bl[b].refl[0][q][mx+n1]
+													* bl[b].refl[1][j][my+n2] * bl[b].refl[2][k][mz+n3];
+												if (dir != NULL && dir->nr > 1)
+													band_str[b] *= rir_directivity_gain(dir, &dir_at, b);
+											}
+											add_image_bands(args, &kernels, LPI, band_x, dist, band_str, &cnt);
+										}
+										else
+										{
+											add_image(args, &kernels, LPI, LPI_f, abs_counter, dist, str, &cnt);
+										}
+									}
+						continue;
+					}
+	
+					for (mz = mz_lo ; mz <= mz_hi ; mz++)
+					{
+						hu[2] = 2*mz*args->L[2];
+	
+						for (q = 0 ; q <= 1*args->dim_s[0] ; q++)
+						{
+                            hu[3] = s[0] - r[0] + 2*q*r[0] + hu[0];
+							if (args->beta_pow != NULL)
+								refl[0] = args->beta_pow[0][abs(mx)] * args->beta_pow[1][abs(mx+q)];
+							else
+								refl[0] = pow(args->beta[0], abs(mx)) * pow(args->beta[1], abs(mx+q));
+							
+                            for (j = 0 ; j <= 1*args->dim_s[1] ; j++)
+							{
+								hu[4] = s[1] - r[1] + 2*j*r[1] + hu[1];
+								if (args->beta_pow != NULL)
+									refl[1] = args->beta_pow[2][abs(my)] * args->beta_pow[3][abs(my+j)];
+								else
+									refl[1] = pow(args->beta[2], abs(my)) * pow(args->beta[3], abs(my+j));
+	
+								for (k = 0 ; k <= 1*args->dim_s[2] ; k++)
+								{
+									hu[5] = s[2] - r[2] + 2*k*r[2] + hu[2];
+									if (args->beta_pow != NULL)
+										refl[2] = args->beta_pow[4][abs(mz)] * args->beta_pow[5][abs(mz+k)];
+									else
+										refl[2] = pow(args->beta[4],abs(mz)) * pow(args->beta[5], abs(mz+k));
+	
+									dist = sqrt(pow(hu[3], 2) + pow(hu[4], 2) + pow(hu[5], 2));
+	
+									fdist = (int) floor(dist);
+									RIR_COUNT(cnt.images_visited++);
+									if (abs(2*mx+q)+abs(2*my+j)+abs(2*mz+k) <= args->order || args->order == -1)
+									{
+										if (fdist < (int)args->horizon)
+										{
+											RIR_COUNT(cnt.images_accepted++);
+
+                                            strength = sim_microphone(hu[3], hu[4], args->angle, args->mtype)
+												* refl[0]*refl[1]*refl[2]/(4*M_PI*dist*args->cTs);
+
+                                            RIR_COUNT(t0 = rir_cycles());
+                                      		if (args->lp_filter == 1)
+                                            {
+                                                if (args->lpf_table != NULL)
+                                                {
+                                                    // Interpolate between the two nearest tabulated kernels
+                                                    double       x = (dist-fdist)*args->lpf_oversampling;
+                                                    int          p = (x < args->lpf_oversampling) ? (int) x : args->lpf_oversampling-1;
+                                                    double       w = x - p;
+                                                    const double* T0 = args->lpf_table + p*(args->Tw+1);
+                                                    const double* T1 = T0 + (args->Tw+1);
+                                                    for (n = 0 ; n < args->Tw+1 ; n++)
+                                                        LPI[n] = T0[n] + w*(T1[n] - T0[n]);
+                                                }
+                                                else
+                                                {
+                                                    for (n = 0 ; n < args->Tw+1 ; n++)
+                                                        LPI[n] = args->hanning_window[n] * args->Fc * sinc( M_PI*args->Fc*(n-(dist-fdist)-(args->Tw/2)) );
+                                                }
+                                                RIR_COUNT(t1 = rir_cycles());
+                                                RIR_COUNT(cnt.cycles_lpf += t1 - t0);
+
+                                                pos = fdist-(args->Tw/2);
+                                                
+                                                for (n = 0; n < args->Tw+1; n++)
+                                                {    
+                                                  if (pos+n >=0 && pos+n < (int)args->nsamples)
+                                                  {
+                                                    RIR_COUNT(cnt.taps_written++);
+                                                    //if ( mx == 0 && my == 0 && mz == 0)
+                                                      abs_counter = (uint64_t)pos+(uint64_t)n +(uint64_t)args->nsamples*(uint64_t)mic_nr + (uint64_t)args->nsamples*(uint64_t)args->nr_of_mics*(uint64_t)loud_nr;//     
+                                                      args->imp[ abs_counter] += strength * LPI[n];  
+                                                  }
+                                                }                                                
+                                                RIR_COUNT(cnt.cycles_scatter += rir_cycles() - t1);
+                                            }
+                                            else
+                                            {
+                                                //if ( mx == 0 && my == 0 && mz == 0)
+                                                abs_counter = (uint64_t)fdist + (uint64_t)args->nsamples*(uint64_t)mic_nr + (uint64_t)args->nsamples*(uint64_t)args->nr_of_mics*(uint64_t)loud_nr;                                                
+                                                args->imp[ abs_counter] += strength;
+                                                RIR_COUNT(cnt.taps_written++);
+                                                RIR_COUNT(cnt.cycles_scatter += rir_cycles() - t0);
+                                            }
+										}
+										else
+										{
+											RIR_COUNT(cnt.images_rejected_distance++);
+										}
+									}
+									else
+									{
+										RIR_COUNT(cnt.images_rejected_order++);
+									}
+								}
+							}
+						}
+					}
+				}
+			}
+	
+			// Combine the octave bands into the response, or into this thread's
+			// partial response: the filterbank is linear, so the partial
+			// responses can be combined before the reduction.
+			if (band_x != NULL)
+			{
+				RIR_COUNT(t0 = rir_cycles());
+				abs_counter = (uint64_t)args->nsamples*(uint64_t)mic_nr + (uint64_t)args->nsamples*(uint64_t)args->nr_of_mics*(uint64_t)loud_nr;
+				if (args->single)
+				{
+					rir_bands_combine(args->bands, band_x, band_h, args->nsamples, kernels.accumulate);
+					for (n = 0 ; n < (int)args->nsamples ; n++)
+					{
+						args->imp_f[abs_counter + n] += (float) band_h[n];
+						band_h[n] = 0;
+					}
+				}
+				else
+				{
+					rir_bands_combine(args->bands, band_x, args->imp + abs_counter, args->nsamples, kernels.accumulate);
+				}
+				RIR_COUNT(cnt.cycles_filterbank += rir_cycles() - t0);
+			}
+
+			// Late reverberation after the horizon. The image-parallel partial
+			// responses get it after the reduction.
+			if (args->tail != NULL && !args->image_parallel)
+			{
+				double mismatch;
+				abs_counter = (uint64_t)args->nsamples*(uint64_t)mic_nr + (uint64_t)args->nsamples*(uint64_t)args->nr_of_mics*(uint64_t)loud_nr;
+				if (args->single)
+					mismatch = rir_tail_add_f(args->tail, args->imp_f + abs_counter, args->nsamples, args->tail_seed + rir);
+				else
+					mismatch = rir_tail_add(args->tail, args->imp + abs_counter, args->nsamples, args->tail_seed + rir);
+				if (fabs(mismatch) > fabs(args->tail_mismatch))
+					args->tail_mismatch = mismatch;
+			}
+		}
+	}
+
+    if (args->simd != RIR_SIMD_OFF)
+    {
+        delete [] z_col;
+        delete [] dist_col;
+        delete [] str_col;
+        delete [] band_x;
+        delete [] band_str;
+        delete [] band_h;
+    }
+    delete [] LPI;
+    if (LPI_f != NULL)
+        delete [] LPI_f;
+
+    // The sum is of no use once a task has failed, which has no part to add
+    if (args->merge_count != NULL && !__atomic_load_n(args->failed, __ATOMIC_RELAXED))
+    {
+        RIR_COUNT(t0 = rir_cycles());
+        impMerge(args);
+        RIR_COUNT(cnt.cycles_reduce += rir_cycles() - t0);
+    }
+
+    RIR_COUNT(cnt.cycles_total = rir_cycles() - t_start);
+    RIR_COUNT(rir_counters_add(&args->thread_counters[pool_thread_nr], cnt));
+   
+    return NULL;
+}
+
+// Sums the partial responses of the image-parallel threads into the first
+// one, over this thread's share of the samples. The pairs are summed in a
+// fixed tree: (0+1)+(2+3), ... so that every sample sees the same order.
+static void *impReduce(void *Args)
+{
+    struct arg_s *args = (struct arg_s *)Args;
+    uint64_t total = (uint64_t)args->nsamples*(uint64_t)args->nr_of_mics*(uint64_t)args->nr_of_louds;
+    uint64_t lo = total*args->tNum/args->tTot;
+    uint64_t hi = total*(args->tNum+1)/args->tTot;
+    RIR_COUNT(uint64_t t_start = rir_cycles());
+
+    for (int stride = 1 ; stride < args->nr_of_parts ; stride *= 2)
+        for (int p = 0 ; p + stride < args->nr_of_parts ; p += 2*stride)
+        {
+            if (args->single)
+                for (uint64_t i = lo ; i < hi ; i++)
+                    args->parts_f[p][i] += args->parts_f[p+stride][i];
+            else
+                for (uint64_t i = lo ; i < hi ; i++)
+                    args->parts[p][i] += args->parts[p+stride][i];
+        }
+
+    RIR_COUNT(args->thread_counters[pool_thread_nr].cycles_reduce += rir_cycles() - t_start);
+    RIR_COUNT(args->thread_counters[pool_thread_nr].cycles_total += rir_cycles() - t_start);
+
+    return NULL;
+}
+
+// Adds the late reverberation to the summed image-parallel responses
+// rir = tNum, tNum+tTot, ... after the reduction.
+static void *impFinish(void *Args)
+{
+    struct arg_s *args = (struct arg_s *)Args;
+    uint64_t nr_of_rirs = (uint64_t)args->nr_of_mics*args->nr_of_louds;
+    RIR_COUNT(uint64_t t_start = rir_cycles());
+
+    for (uint64_t rir = args->tNum ; rir < nr_of_rirs ; rir += args->tTot)
+    {
+        if (args->changed != NULL && !args->changed[rir])
+            continue;
+        double mismatch;
+        if (args->single)
+            mismatch = rir_tail_add_f(args->tail, args->parts_f[0] + rir*args->nsamples, args->nsamples, args->tail_seed + rir);
+        else
+            mismatch = rir_tail_add(args->tail, args->parts[0] + rir*args->nsamples, args->nsamples, args->tail_seed + rir);
+        if (fabs(mismatch) > fabs(args->tail_mismatch))
+            args->tail_mismatch = mismatch;
+    }
+
+    RIR_COUNT(args->thread_counters[pool_thread_nr].cycles_total += rir_cycles() - t_start);
+
+    return NULL;
+}
+
+// A task of the high-pass filter: the responses begin .. end-1 of h or h_f,
+// nsamples each, with only those of which changed[rir % nr_of_rirs] != 0
+// (Session) when changed is not NULL.
+struct hpf_s
+{
+    const struct rir_hpf* filter;
+    int           simd;
+    double*       h;
+    float*        h_f;
+    unsigned int  nsamples;
+    uint64_t      begin;
+    uint64_t      end;
+    const unsigned char* changed;
+    uint64_t      nr_of_rirs;
+    rir::Counters* thread_counters;   // per pool thread (RIR_COUNTERS), else NULL
+};
+
+// Filters the responses of a task, the runs of consecutive ones in the lanes
+// of the kernel.
+static void *impFilter(void *Args)
+{
+    struct hpf_s *args = (struct hpf_s *)Args;
+    uint64_t rir = args->begin;
+    RIR_COUNT(uint64_t t_start = rir_cycles());
+
+    while (rir < args->end)
+    {
+        uint64_t first = rir;
+
+        while (rir < args->end && (args->changed == NULL || args->changed[rir % args->nr_of_rirs]))
+            rir++;
+        if (rir > first && args->h_f != NULL)
+            rir_hpf_apply_f(args->filter, args->simd, args->h_f + first*args->nsamples, args->nsamples, rir - first);
+        else if (rir > first)
+            rir_hpf_apply(args->filter, args->simd, args->h + first*args->nsamples, args->nsamples, rir - first);
+        if (rir == first)
+            rir++;
+    }
+
+    RIR_COUNT(if (args->thread_counters != NULL)
+    {
+        args->thread_counters[pool_thread_nr].cycles_hp_filter += rir_cycles() - t_start;
+        args->thread_counters[pool_thread_nr].cycles_total += rir_cycles() - t_start;
+    })
+
+    return NULL;
+}
+
+// Persistent worker pool. The threads are started on the first call, and
+// more are added when a later call asks for more, so that a sweep over many
+// small RIRs does not pay for thread creation on every call. Only the first
+// 'active' threads take tasks, so that a call asking for fewer threads than
+// an earlier one uses no more. They live until rir::shutdown_threads(),
+// which the MEX files register with mexAtExit.
+//
+// There is one pool per process, shared by all Generators, Sessions,
+// Convolvers and hp_filter calls. pool_call serializes them: it is held
+// while the pool grows, pins its threads, runs the tasks of one caller or
+// stops, so that calls from different threads take turns instead of
+// overwriting each other's queue.
+struct task_s
+{
+    void*         (*fn)(void *);
+    void*         arg;
+};
+
+struct pool_s
+{
+    pthread_t*      threads;
+    int             nr_of_threads;
+    pthread_mutex_t lock;
+    pthread_cond_t  work;       // tasks were queued or the pool stops
+    pthread_cond_t  done;       // the last pending task has finished
+    struct task_s*  queue;
+    int             queue_size;
+    int             head;
+    int             tail;
+    int             pending;    // tasks queued or running
+    int             active;     // threads 0 .. active-1 take tasks
+    int             stop;
+    int*            cpu;        // CPU a thread is pinned to, -1 = none
+};
+
+static struct pool_s pool = { NULL, 0, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER,
+    PTHREAD_COND_INITIALIZER, NULL, 0, 0, 0, 0, 0, 0, NULL };
+static pthread_mutex_t pool_call = PTHREAD_MUTEX_INITIALIZER;
+
+// CPUs and nodes for Config::affinity, read on its first use
+static struct rir_numa pool_numa;
+static int pool_numa_loaded = 0;
+
+static void *pool_worker(void *nr)
+{
+    struct task_s task;
+    int           thread_nr = (int)(intptr_t)nr;
+
+    pthread_mutex_lock(&pool.lock);
+    while (1)
+    {
+        while (!pool.stop && (pool.head == pool.tail || thread_nr >= pool.active))
+            pthread_cond_wait(&pool.work, &pool.lock);
+        if (pool.stop)
+            break;
+
+        RIR_COUNT(pool_thread_nr = thread_nr);
+        task = pool.queue[pool.head++];
+        pthread_mutex_unlock(&pool.lock);
+        task.fn(task.arg);
+        pthread_mutex_lock(&pool.lock);
+
+        if (--pool.pending == 0)
+            pthread_cond_broadcast(&pool.done);
+    }
+    pthread_mutex_unlock(&pool.lock);
+
+    return NULL;
+}
+
+// Stops and joins all pool threads.
+static void pool_shutdown(void)
+{
+    pthread_mutex_lock(&pool_call);
+    pthread_mutex_lock(&pool.lock);
+    pool.stop = 1;
+    pthread_cond_broadcast(&pool.work);
+    pthread_mutex_unlock(&pool.lock);
+
+    for (int t = 0 ; t < pool.nr_of_threads ; t++)
+        pthread_join(pool.threads[t], NULL);
+
+    delete [] pool.threads;
+    delete [] pool.queue;
+    delete [] pool.cpu;
+    pool.threads = NULL;
+    pool.cpu = NULL;
+    pool.nr_of_threads = 0;
+    pool.queue = NULL;
+    pool.queue_size = 0;
+    pool.head = 0;
+    pool.tail = 0;
+    pool.stop = 0;
+    pool.active = 0;
+    pthread_mutex_unlock(&pool_call);
+}
+
+// Makes sure the pool has at least n threads, with pool_call held.
+// Returns 0 on success.
+static int pool_grow(int n)
+{
+    pthread_attr_t attr;
+    pthread_t*     threads;
+    int*           cpu;
+    int            rc = 0;
+
+    if (n <= pool.nr_of_threads)
+        return 0;
+
+    threads = new pthread_t[n];
+    cpu = new int[n];
+    for (int t = 0 ; t < n ; t++)
+        cpu[t] = (t < pool.nr_of_threads) ? pool.cpu[t] : -1;
+    for (int t = 0 ; t < pool.nr_of_threads ; t++)
+        threads[t] = pool.threads[t];
+    delete [] pool.threads;
+    delete [] pool.cpu;
+    pool.threads = threads;
+    pool.cpu = cpu;
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+    for ( ; pool.nr_of_threads < n ; pool.nr_of_threads++)
+    {
+        rc = pthread_create(&pool.threads[pool.nr_of_threads], &attr, pool_worker, (void *)(intptr_t)pool.nr_of_threads);
+        if (rc)
+            break;
+    }
+    pthread_attr_destroy(&attr);
+
+    return rc;
+}
+
+// Makes sure the pool has at least n threads. Returns 0 on success.
+static int pool_start(int n)
+{
+    int rc;
+
+    pthread_mutex_lock(&pool_call);
+    rc = pool_grow(n);
+    pthread_mutex_unlock(&pool_call);
+
+    return rc;
+}
+
+// Pins the threads 0 .. n-1 of the pool for Config::affinity, or unpins
+// them for AFFINITY_NONE, and stores the CPU and node of thread t in cpu[t]
+// and node[t], -1 when it is not pinned. Only threads whose CPU changes are
+// touched, so that repeated calls cost nothing.
+static void pool_place(int affinity, int n, int* cpu, int* node)
+{
+    pthread_mutex_lock(&pool_call);
+    if (affinity != RIR_AFFINITY_NONE && !pool_numa_loaded)
+    {
+        rir_numa_load(&pool_numa);
+        pool_numa_loaded = 1;
+    }
+
+    for (int t = 0 ; t < n ; t++)
+    {
+        int slot = -1;
+
+        if (affinity != RIR_AFFINITY_NONE && pool_numa.nr_of_cpus > 0)
+            slot = rir_numa_slot(&pool_numa, affinity, t);
+        cpu[t] = (slot < 0) ? -1 : pool_numa.cpu[slot];
+        node[t] = (slot < 0) ? -1 : pool_numa.node[slot];
+        if (t >= pool.nr_of_threads)
+        {
+            cpu[t] = node[t] = -1;
+            continue;
+        }
+        if (cpu[t] != pool.cpu[t] && rir_numa_pin(&pool_numa, pool.threads[t], cpu[t]) == 0)
+            pool.cpu[t] = cpu[t];
+        if (cpu[t] != pool.cpu[t])
+            cpu[t] = node[t] = -1;
+    }
+    pthread_mutex_unlock(&pool_call);
+}
+
+// Queues fn(&args[t]) for t = 0 .. n-1, with args an array of structures of
+// size bytes, on the first nr_of_threads threads and waits until all have
+// finished, calling the progress function while waiting when there is one.
+static void pool_run(void *(*fn)(void *), void* args, size_t size, int n, int nr_of_threads,
+    struct rir_progress* progress)
+{
+    pthread_mutex_lock(&pool_call);
+
+    // The threads that pool_start() made may have been stopped since by
+    // shutdown_threads() in another thread
+    pool_grow(nr_of_threads);
+    if (pool.nr_of_threads < nr_of_threads)
+        nr_of_threads = pool.nr_of_threads;
+    if (nr_of_threads == 0)
+    {
+        pthread_mutex_unlock(&pool_call);
+        if (progress != NULL)
+            progress->inline_poll = 1;
+        for (int t = 0 ; t < n ; t++)
+            fn((void *)((char *)args + t*size));
+        return;
+    }
+
+    pthread_mutex_lock(&pool.lock);
+
+    if (pool.queue_size < n)
+    {
+        delete [] pool.queue;
+        pool.queue = new struct task_s[n];
+        pool.queue_size = n;
+    }
+    pool.head = 0;
+    pool.tail = 0;
+    for (int t = 0 ; t < n ; t++)
+    {
+        pool.queue[pool.tail].fn = fn;
+        pool.queue[pool.tail].arg = (void *)((char *)args + t*size);
+        pool.tail++;
+    }
+    pool.pending = n;
+    pool.active = nr_of_threads;
+    pthread_cond_broadcast(&pool.work);
+
+    while (pool.pending > 0)
+    {
+        if (progress == NULL)
+            pthread_cond_wait(&pool.done, &pool.lock);
+        else
+        {
+            struct timespec until;
+            clock_gettime(CLOCK_REALTIME, &until);
+            until.tv_nsec += (long)(RIR_PROGRESS_INTERVAL*1e9);
+            if (until.tv_nsec >= 1000000000)
+            {
+                until.tv_sec++;
+                until.tv_nsec -= 1000000000;
+            }
+            pthread_cond_timedwait(&pool.done, &pool.lock, &until);
+
+            pthread_mutex_unlock(&pool.lock);
+            rir_progress_poll(progress);
+            pthread_mutex_lock(&pool.lock);
+        }
+    }
+
+    pthread_mutex_unlock(&pool.lock);
+    pthread_mutex_unlock(&pool_call);
+}
+
+// Runs fn(&args[t]) for t = 0 .. n-1 on the pool, or in the calling thread
+// when only one thread is used; the tasks then call the progress function.
+static void run_tasks(void *(*fn)(void *), void* args, size_t size, int n, int nr_of_threads,
+    struct rir_progress* progress)
+{
+    if (progress != NULL)
+        progress->inline_poll = (nr_of_threads == 1);
+    if (nr_of_threads == 1)
+    {
+        for (int t = 0 ; t < n ; t++)
+            fn((void *)((char *)args + t*size));
+    }
+    else
+        pool_run(fn, args, size, n, nr_of_threads, progress);
+}
+
+// High-pass filters the count responses of nsamples samples from h or h_f in
+// place with the kernel of the level simd, as hp_filter = 1 does. The
+// responses are split over the threads in runs of whole groups of lanes;
+// changed and thread_counters as for struct hpf_s. The pool has to hold
+// nr_of_threads threads.
+static void filter_rirs(double fs, int simd, double* h, float* h_f, unsigned int nsamples, uint64_t count,
+    const unsigned char* changed, uint64_t nr_of_rirs, int nr_of_threads, rir::Counters* thread_counters)
+{
+    const uint64_t group = 8;           // a multiple of the lanes of every kernel
+    uint64_t       nr_of_groups = (count + group-1)/group;
+    int            nr_of_tasks = (nr_of_groups < (uint64_t)nr_of_threads) ? (int)nr_of_groups : nr_of_threads;
+    struct rir_hpf filter;
+
+    if (count == 0)
+        return;
+    rir_hpf_init(&filter, fs);
+
+    std::vector<struct hpf_s> tArgs(nr_of_tasks);
+    for (int t = 0 ; t < nr_of_tasks ; t++)
+    {
+        struct hpf_s* a = &tArgs[t];
+
+        a->filter = &filter;
+        a->simd = simd;
+        a->h = h;
+        a->h_f = h_f;
+        a->nsamples = nsamples;
+        a->begin = nr_of_groups*t/nr_of_tasks*group;
+        a->end = nr_of_groups*(t+1)/nr_of_tasks*group;
+        if (a->end > count)
+            a->end = count;
+        a->changed = changed;
+        a->nr_of_rirs = nr_of_rirs;
+        a->thread_counters = thread_counters;
+    }
+    run_tasks(impFilter, &tArgs[0], sizeof(struct hpf_s), nr_of_tasks, nr_of_tasks, NULL);
+}
+
+// A task of rir::Convolver. The spectra of the input blocks of source n are
+// kept in nr_of_slots slots from X + n*nr_of_slots*S, block k in slot
+// k % nr_of_slots, with S = 2*(block_size+1) doubles per spectrum.
+struct conv_s
+{
+    const struct rir_fft* fft;
+    unsigned int  block_size;
+    unsigned int  nr_of_mics;
+    unsigned int  nr_of_louds;
+    unsigned int  nr_of_parts;
+    const double* H;            // spectra of the response blocks, (n*M + m)*P + p
+    double*       X;
+    uint64_t      nr_of_slots;
+    const double* x;            // convSpectra: the source signals
+    double*       y;            // convBlocks: the receiver signals
+    uint64_t      length;       // samples per signal of x and y
+    uint64_t      first;        // block of sample 0 of y
+    unsigned int  mic;          // convBlocks: receiver of the task
+    uint64_t      begin;        // blocks begin .. end-1; for convSpectra the
+    uint64_t      end;          // slots n*nr_of_slots + k of all sources
+};
+
+// Spectra of the input blocks: the FFT of samples (k-1)*B .. (k+1)*B-1 of
+// the source, zero outside the signal.
+static void *convSpectra(void *Args)
+{
+    struct conv_s* args = (struct conv_s*) Args;
+    const int      B = args->block_size;
+    const int      S = 2*(B+1);
+    double*        frame = new double[2*B];
+    double*        z = new double[2*B];
+
+    for (uint64_t q = args->begin ; q < args->end ; q++)
+    {
+        uint64_t      k = q % args->nr_of_slots;
+        const double* x = args->x + (q / args->nr_of_slots)*args->length;
+
+        for (int i = 0 ; i < 2*B ; i++)
+        {
+            int64_t t = (int64_t)(k*B) - B + i;
+            frame[i] = (t >= 0 && (uint64_t)t < args->length) ? x[t] : 0;
+        }
+        rir_fft_forward(args->fft, frame, args->X + q*S, z);
+    }
+
+    delete [] frame;
+    delete [] z;
+    return NULL;
+}
+
+// Output blocks of one receiver: the sum over the sources and the response
+// blocks p of H_p times the spectrum of input block k-p; the last B samples
+// of its inverse FFT are output block k (overlap-save).
+static void *convBlocks(void *Args)
+{
+    struct conv_s* args = (struct conv_s*) Args;
+    const int      B = args->block_size;
+    const int      S = 2*(B+1);
+    const int      P = args->nr_of_parts;
+    double*        Y = new double[S];
+    double*        frame = new double[2*B];
+    double*        z = new double[2*B];
+    double*        y = args->y + (uint64_t)args->mic*args->length;
+
+    for (uint64_t k = args->begin ; k < args->end ; k++)
+    {
+        memset(Y, 0, S*sizeof(double));
+        for (unsigned int n = 0 ; n < args->nr_of_louds ; n++)
+        {
+            const double* H = args->H + ((uint64_t)n*args->nr_of_mics + args->mic)*P*S;
+            const double* X = args->X + n*args->nr_of_slots*S;
+
+            for (uint64_t p = 0 ; p < (uint64_t)P && p <= k ; p++)
+                rir_spectrum_mac(Y, H + p*S, X + ((k-p) % args->nr_of_slots)*S, B+1);
+        }
+        rir_fft_inverse(args->fft, Y, frame, z);
+
+        for (int i = 0 ; i < B ; i++)
+        {
+            uint64_t t = (k - args->first)*B + i;
+            if (t < args->length)
+                y[t] = frame[B+i];
+        }
+    }
+
+    delete [] Y;
+    delete [] frame;
+    delete [] z;
+    return NULL;
+}
+
+namespace rir
+{
+
+Generator::Generator(const Config& config)
+	: config_(config), cancelled_(0)
+{
+	if (config_.enumeration != ENUM_BOX && config_.enumeration != ENUM_SPHERE)
+		throw Error("Error: options.enumeration must be 'sphere' or 'box'.");
+	if (config_.parallel < PARALLEL_AUTO || config_.parallel > PARALLEL_IMAGE)
+		throw Error("Error: options.parallel must be 'auto', 'mic' or 'image'.");
+	if (config_.affinity < AFFINITY_NONE || config_.affinity > AFFINITY_SCATTER)
+		throw Error("Error: options.affinity must be 'none', 'compact' or 'scatter'.");
+	if (config_.simd < SIMD_OFF || config_.simd > SIMD_AUTO)
+		throw Error("Error: options.simd must be 'auto', 'avx512', 'avx2', 'sse2', 'scalar' or 'off'.");
+	if (config_.simd != SIMD_AUTO && !rir_simd_supported(config_.simd))
+		throw Error("Error: the instruction set in options.simd is not supported by this CPU.");
+	if (config_.order < -1 || config_.lpf_oversampling < 0 || config_.num_threads < 0 || config_.max_images < 0 ||
+		config_.transition < 0 || config_.nr_of_bands < 0 ||
+		(config_.nr_of_bands > 0 && config_.band_fc <= 0))
+		throw Error("Invalid input arguments!");
+	if (config_.directivity != NULL && (config_.directivity_az < 1 || config_.directivity_el < 2 ||
+		!(config_.directivity_bands == 1 || config_.directivity_bands == config_.nr_of_bands)))
+		throw Error("Error: options.directivity must be E x A with E >= 2, or E x A x B for B octave bands of beta.");
+	if (config_.orientation != NULL && (config_.orientation_rows < 1 ||
+		(config_.orientation_cols != 3 && config_.orientation_cols != 4)))
+		throw Error("Error: orientation must be an angle, [yaw pitch roll] or a quaternion [w x y z] per receiver.");
+	if (config_.nr_of_bands > 1 && rir_bands_crossover(config_.band_fc, config_.nr_of_bands-2) >= config_.fs/2)
+		throw Error("Error: the octave bands of beta must lie below fs/2.");
+
+	simd_ = (config_.simd == SIMD_AUTO) ? rir_simd_parse("auto") : config_.simd;
+	table_bytes_.lattice = 0;
+	table_bytes_.gains = 0;
+	table_bytes_.lpf = 0;
+	table_bytes_.tail = 0;
+	table_bytes_.filterbank = 0;
+	counters_ = Counters();
+	tail_mismatch_ = 0;
+}
+
+void Generator::compute(const Room* rooms, unsigned int nr_of_rooms, unsigned int nr_of_mics,
+	unsigned int nr_of_louds, double* h)
+{
+	run(rooms, nr_of_rooms, nr_of_mics, nr_of_louds, h, NULL, NULL);
+}
+
+void Generator::compute(const Room* rooms, unsigned int nr_of_rooms, unsigned int nr_of_mics,
+	unsigned int nr_of_louds, float* h)
+{
+	run(rooms, nr_of_rooms, nr_of_mics, nr_of_louds, NULL, h, NULL);
+}
+
+void Generator::compute(const Room* rooms, unsigned int nr_of_rooms, unsigned int nr_of_mics,
+	unsigned int nr_of_louds, struct rir_image_list* lists)
+{
+	run(rooms, nr_of_rooms, nr_of_mics, nr_of_louds, NULL, NULL, lists);
+}
+
+void Generator::compute_file(const Room* rooms, unsigned int nr_of_rooms, unsigned int nr_of_mics,
+	unsigned int nr_of_louds, const char* path, bool single)
+{
+	struct rir_tables* tb = prepare(rooms, nr_of_rooms, nr_of_mics, nr_of_louds, single, 0, 1);
+	struct rir_file    file;
+	char               msg[512];
+
+	if (!rir_file_create(&file, path, config_.nsamples, nr_of_mics, nr_of_louds, nr_of_rooms, config_.fs,
+		single ? sizeof(float) : sizeof(double)))
+	{
+		snprintf(msg, sizeof(msg), "Error: Cannot create the file %s (%s).", path, strerror(errno));
+		release(tb);
+		throw Error(msg);
+	}
+
+	try
+	{
+		execute(tb, single ? NULL : (double*) file.data, single ? (float*) file.data : NULL, NULL, NULL);
+	}
+	catch (...)
+	{
+		rir_file_close(&file, 0);
+		release(tb);
+		throw;
+	}
+	release(tb);
+
+	if (!rir_file_close(&file, !cancelled_))
+	{
+		snprintf(msg, sizeof(msg), "Error: Cannot write the file %s.", path);
+		throw Error(msg);
+	}
+}
+
+void Generator::run(const Room* rooms_in, unsigned int nr_of_rooms, unsigned int nr_of_mics,
+	unsigned int nr_of_louds, double* imp, float* imp_f, struct rir_image_list* lists)
+{
+	struct rir_tables* tb = prepare(rooms_in, nr_of_rooms, nr_of_mics, nr_of_louds, imp_f != NULL, lists != NULL, 0);
+
+	try
+	{
+		execute(tb, imp, imp_f, lists, NULL);
+	}
+	catch (...)
+	{
+		release(tb);
+		throw;
+	}
+	release(tb);
+
+	if (lists != NULL)
+	{
+		for (uint64_t i = 0 ; i < (uint64_t)nr_of_mics*nr_of_louds*nr_of_rooms ; i++)
+			if (lists[i].failed)
+				throw Error("Error: Out of memory while collecting the images.");
+	}
+}
+
+struct rir_tables* Generator::prepare(const Room* rooms_in, unsigned int nr_of_rooms, unsigned int nr_of_mics,
+	unsigned int nr_of_louds, int single, int images, int mapped)
+{
+	const Config&  cfg = config_;
+	const unsigned int nsamples = cfg.nsamples;
+	const double   fs = cfg.fs;
+	const int      lp_filter = cfg.lp_filter;
+	const int      lpf_oversampling = cfg.lpf_oversampling;
+	int            dim_s[3];
+	int            simd = simd_;
+
+	// The reference per-image loop only exists in double precision and only
+	// builds responses
+	if ((single || images || cfg.nr_of_bands > 0 || cfg.directivity != NULL ||
+		cfg.orientation != NULL || cfg.mtypes != NULL) && simd == RIR_SIMD_OFF)
+		simd = RIR_SIMD_SCALAR;
+
+	for (int i = 0 ; i < 3 ; i++)
+		dim_s[i] = (cfg.dim[i] == 0) ? 0 : 1;
+
+	// Temporary variables and constants (image-method)
+	const double Fc = 1;
+	const int    Tw = (ROUND(cfg.window_l*fs) < 1) ? 1 : ROUND(cfg.window_l*fs);
+	const double cTs = cfg.c/fs;
+	const uint64_t nr_of_rirs = (uint64_t)nr_of_mics*nr_of_louds;
+
+	// With options.transition the images are only computed up to the
+	// horizon and the rest of the responses is a stochastic tail, fitted over
+	// two windows of 20 ms before it.
+	const int    tail = (cfg.transition > 0 && ROUND(cfg.transition*fs) < (long)nsamples);
+	const unsigned int horizon = tail ? (unsigned int) ROUND(cfg.transition*fs) : nsamples;
+	const int    tail_window = (ROUND(0.02*fs) < 1) ? 1 : ROUND(0.02*fs);
+
+	if (cfg.transition > 0 && images)
+		throw Error("Error: options.transition cannot be used with output 'images'.");
+	if (tail && (dim_s[0] == 0 || dim_s[1] == 0 || dim_s[2] == 0))
+		throw Error("Error: options.transition needs a room with all three dimensions.");
+	if (tail && (int)horizon - Tw/2 - 2*tail_window < 0)
+		throw Error("Error: options.transition leaves too few images for the fit of the late reverberation.");
+
+	// Octave bands
+	const int    bands = (cfg.nr_of_bands > 0);
+	struct rir_bands filterbank;
+
+	if (bands && images)
+		throw Error("Error: octave-band beta cannot be used with output 'images'.");
+	if (bands && cfg.transition > 0)
+		throw Error("Error: options.transition cannot be used with octave-band beta.");
+	for (unsigned int k = 0 ; bands && k < nr_of_rooms ; k++)
+		if (rooms_in[k].band_beta == NULL)
+			throw Error("Invalid input arguments!");
+
+	// Pattern of every receiver and, with Config::orientation, its axes
+	std::vector<double> pattern(2*nr_of_mics);
+	std::vector<double> axes;
+
+	for (unsigned int m = 0 ; m < nr_of_mics ; m++)
+		mic_pattern((cfg.mtypes != NULL) ? cfg.mtypes[m] : cfg.mtype, &pattern[2*m], &pattern[2*m+1]);
+	if (cfg.orientation != NULL)
+	{
+		if (cfg.orientation_rows != 1 && cfg.orientation_rows != (int)nr_of_mics)
+			throw Error("Error: orientation must give one row for all receivers or one per receiver.");
+		axes.resize(9*nr_of_mics);
+		for (unsigned int m = 0 ; m < nr_of_mics ; m++)
+		{
+			int    row = (cfg.orientation_rows > 1) ? m : 0;
+			double o[4];
+
+			for (int i = 0 ; i < cfg.orientation_cols ; i++)
+				o[i] = cfg.orientation[row + i*cfg.orientation_rows];
+			if (cfg.orientation_cols == 3)
+				rir_axes_ypr(o, &axes[9*m]);
+			else if (!rir_axes_quat(o, &axes[9*m]))
+				throw Error("Error: orientation has a zero quaternion.");
+		}
+	}
+
+    int          n;
+	
+    //Temporary variables for the threads.
+    int numCPU;
+    int nr_of_parts;
+    int nr_of_tasks;
+    struct room_s** schedule;
+    int image_parallel;
+
+    // Retreiving number of machine cores
+    numCPU = (cfg.num_threads > 0) ? cfg.num_threads : sysconf( _SC_NPROCESSORS_ONLN );
+    
+    // With fewer RIRs than cores, threads computing one RIR each would leave
+    // cores idle, so the images of every RIR are split over the threads instead.
+    // Responses mapped from a file are computed mic-parallel, since every
+    // image-parallel thread would need a copy of all of them in memory.
+    // With Config::deterministic the split may not depend on the number of
+    // threads either, and is made as if there were a thread per part.
+    if (cfg.parallel == PARALLEL_AUTO)
+        image_parallel = (nr_of_rooms == 1 && !images && !mapped &&
+            nr_of_rirs < (uint64_t)(cfg.deterministic ? RIR_DETERMINISTIC_PARTS : numCPU));
+    else
+        image_parallel = (cfg.parallel == PARALLEL_IMAGE);
+    if (image_parallel && nr_of_rooms > 1)
+        throw Error("Error: options.parallel = 'image' cannot be used for a batch of rooms.");
+    if (image_parallel && images)
+        throw Error("Error: options.parallel = 'image' cannot be used with output 'images'.");
+    if (image_parallel && mapped)
+        throw Error("Error: options.parallel = 'image' cannot be used with options.file.");
+
+    // Image-parallel: one task per partial response, one per thread or with
+    // Config::deterministic a fixed number of them, so that the images of a
+    // task and the order of the sum do not depend on the number of threads.
+    // Mic-parallel: one task per RIR. If the total number of tasks is less
+    // than the number of available cores then we use as many cores as tasks.
+    nr_of_parts = image_parallel ? (cfg.deterministic ? RIR_DETERMINISTIC_PARTS : numCPU) : 0;
+    nr_of_tasks = image_parallel ? nr_of_parts : (int)(nr_of_rirs*nr_of_rooms);
+    if(nr_of_tasks < numCPU)
+    {
+        numCPU = nr_of_tasks;
+    }
+
+    if (numCPU > 1 && pool_start(numCPU))
+    {
+        throw Error("Problem with creating the thread (pthread_create).");
+    }
+
+	double*      hanning_window = new double[Tw+1];
+	double*      lpf_table = NULL;
+	float*       hanning_window_f = NULL;
+	float*       lpf_table_f = NULL;
+	struct room_s* rooms = new struct room_s[nr_of_rooms];
+
+    for (unsigned int k = 0 ; k < nr_of_rooms ; k++)
+    {
+        struct room_s* room = &rooms[k];
+        double*        L = room->L;
+
+        room->nr = k;
+        room->rr = rooms_in[k].r;
+        room->ss = rooms_in[k].s;
+        room->beta_pow = NULL;
+        room->band_lattice = NULL;
+
+        // No reflections along the axes that are not used. With octave bands
+        // the images get unit wall gains here and those of the bands later.
+        for (int i = 0 ; i < 6 ; i++)
+            room->beta[i] = (dim_s[i/2] == 0) ? 0 : bands ? 1 : rooms_in[k].beta[i];
+        for (int i = 0 ; i < 3 ; i++)
+            L[i] = rooms_in[k].L[i]/cTs;
+        room->cost = rir_cost(horizon, L, dim_s, cfg.enumeration, lp_filter, Tw);
+
+		// Reflection gains beta_i^n for every reflection count n that occurs in the
+		// image box. The box is the same for every receiver, so the tables are
+		// built once per room and shared read-only by all threads.
+		if (cfg.gain_tables == 1)
+		{
+			room->beta_pow = new double*[6];
+			for (int i = 0 ; i < 6 ; i++)
+			{
+				int n_max = (int) ceil(horizon/(2*L[i/2]))*dim_s[i/2] + 1;
+				room->beta_pow[i] = new double[n_max+1];
+				for (n = 0 ; n <= n_max ; n++)
+					room->beta_pow[i][n] = pow(room->beta[i], n);
+			}
+		}
+
+		// Lattice offsets and reflection gains per axis for the vectorized
+		// path, read by all (source, receiver) pairs of the room.
+		if (simd != RIR_SIMD_OFF)
+			rir_lattice_build(&room->lattice, horizon, L, dim_s, room->beta, room->beta_pow);
+
+		// The wall gains of every octave band on the same lattice
+		if (bands)
+		{
+			room->band_lattice = new struct rir_lattice[cfg.nr_of_bands];
+			for (int b = 0 ; b < cfg.nr_of_bands ; b++)
+			{
+				double beta_b[6];
+				for (int i = 0 ; i < 6 ; i++)
+					beta_b[i] = (dim_s[i/2] == 0) ? 0 : rooms_in[k].band_beta[6*b + i];
+				rir_lattice_build(&room->band_lattice[b], horizon, L, dim_s, beta_b, NULL);
+			}
+		}
+
+		// Envelope of the late reverberation, shared by all pairs of the room
+		if (tail)
+			rir_tail_build(&room->tail, nsamples, horizon, tail_window, Tw, L, room->beta);
+    }
+
+	// Hanning window
+	for (n = 0 ; n < Tw+1 ; n++)
+	{
+		hanning_window[n] = 0.5 * (1 + cos(2*M_PI*(n+Tw/2)/Tw));
+	}
+
+	// Windowed-sinc LPF kernels for the fractional delays p/lpf_oversampling,
+	// p = 0 .. lpf_oversampling, stored row after row.
+	if (lp_filter == 1 && lpf_oversampling > 0)
+	{
+		lpf_table = new double[(lpf_oversampling+1)*(Tw+1)];
+		for (int p = 0 ; p <= lpf_oversampling ; p++)
+			for (n = 0 ; n < Tw+1 ; n++)
+				lpf_table[p*(Tw+1) + n] = hanning_window[n] * Fc * sinc( M_PI*Fc*(n-(double)p/lpf_oversampling-(Tw/2)) );
+	}
+
+	// Filterbank combining the octave bands
+	if (bands)
+		rir_bands_build(&filterbank, cfg.nr_of_bands, cfg.band_fc, fs);
+
+	// Single precision copies of the window and the kernel table
+	if (single)
+	{
+		hanning_window_f = new float[Tw+1];
+		for (n = 0 ; n < Tw+1 ; n++)
+			hanning_window_f[n] = (float) hanning_window[n];
+		if (lpf_table != NULL)
+		{
+			lpf_table_f = new float[(lpf_oversampling+1)*(Tw+1)];
+			for (n = 0 ; n < (lpf_oversampling+1)*(Tw+1) ; n++)
+				lpf_table_f[n] = (float) lpf_table[n];
+		}
+	}
+
+	table_bytes_.lattice = 0;
+	table_bytes_.gains = 0;
+	table_bytes_.tail = 0;
+	for (unsigned int k = 0 ; k < nr_of_rooms ; k++)
+	{
+		if (simd != RIR_SIMD_OFF)
+			table_bytes_.lattice += rooms[k].lattice.bytes;
+		for (int b = 0 ; bands && b < cfg.nr_of_bands ; b++)
+			table_bytes_.lattice += rooms[k].band_lattice[b].bytes;
+		if (rooms[k].beta_pow != NULL)
+			for (int i = 0 ; i < 6 ; i++)
+				table_bytes_.gains += ((int) ceil(horizon/(2*rooms[k].L[i/2]))*dim_s[i/2] + 2)*sizeof(double);
+		if (tail)
+			table_bytes_.tail += rooms[k].tail.bytes;
+	}
+	table_bytes_.filterbank = bands ? filterbank.bytes : 0;
+	table_bytes_.lpf = (lpf_table != NULL) ? (size_t)(lpf_oversampling+1)*(Tw+1)*(sizeof(double) + (single ? sizeof(float) : 0)) : 0;
+
+    // The threads take the tasks in order, so queueing the RIRs of the most
+    // expensive rooms first keeps the threads busy until the end of a batch
+    // in which the cost per room differs a lot.
+    schedule = new struct room_s*[nr_of_rooms];
+    for (unsigned int k = 0 ; k < nr_of_rooms ; k++)
+        schedule[k] = &rooms[k];
+    qsort(schedule, nr_of_rooms, sizeof(struct room_s*), cmp_room_cost);
+
+	struct rir_tables* tb = new struct rir_tables;
+
+	tb->nr_of_rooms = nr_of_rooms;
+	tb->nr_of_mics = nr_of_mics;
+	tb->nr_of_louds = nr_of_louds;
+	tb->single = single;
+	tb->simd = simd;
+	for (int i = 0 ; i < 3 ; i++)
+		tb->dim_s[i] = dim_s[i];
+	tb->Tw = Tw;
+	tb->cTs = cTs;
+	tb->horizon = horizon;
+	tb->tail = tail;
+	tb->bands = bands;
+	tb->numCPU = numCPU;
+	tb->image_parallel = image_parallel;
+	tb->nr_of_parts = nr_of_parts;
+	tb->nr_of_tasks = nr_of_tasks;
+	tb->mtype[0] = cfg.mtype;
+	tb->mtype[1] = 0;
+	tb->directivity.gain = cfg.directivity;
+	tb->directivity.n_az = cfg.directivity_az;
+	tb->directivity.n_el = cfg.directivity_el;
+	tb->directivity.nr = cfg.directivity_bands;
+	tb->pattern.swap(pattern);
+	tb->axes.swap(axes);
+	tb->hanning_window = hanning_window;
+	tb->lpf_table = lpf_table;
+	tb->hanning_window_f = hanning_window_f;
+	tb->lpf_table_f = lpf_table_f;
+	tb->filterbank = filterbank;
+	tb->rooms = rooms;
+	tb->schedule = schedule;
+	return tb;
+}
+
+// Computes the responses, or the image lists, of the rooms of tb at the
+// positions of their receivers and sources, into the output of the call, and
+// with changed only the RIRs rir of the room for which changed[rir] != 0. The
+// others are left as they are.
+void Generator::execute(struct rir_tables* tb, double* imp, float* imp_f, struct rir_image_list* lists,
+	const unsigned char* changed)
+{
+	const Config&  cfg = config_;
+	const unsigned int nsamples = cfg.nsamples;
+	const double   fs = cfg.fs;
+	const int      single = tb->single;
+	const int      lp_filter = cfg.lp_filter;
+	const int      hp_filter = cfg.hp_filter;
+	const int      lpf_oversampling = cfg.lpf_oversampling;
+	const int      simd = tb->simd;
+	const int      Tw = tb->Tw;
+	const double   Fc = 1;
+	const double   cTs = tb->cTs;
+	const unsigned int nr_of_rooms = tb->nr_of_rooms;
+	const unsigned int nr_of_mics = tb->nr_of_mics;
+	const unsigned int nr_of_louds = tb->nr_of_louds;
+	const uint64_t nr_of_rirs = (uint64_t)nr_of_mics*nr_of_louds;
+	const int      numCPU = tb->numCPU;
+	const int      image_parallel = tb->image_parallel;
+	const int      nr_of_parts = tb->nr_of_parts;
+	const int      nr_of_tasks = tb->nr_of_tasks;
+	const int      tail = tb->tail;
+	const int      bands = tb->bands;
+	struct room_s** schedule = tb->schedule;
+
+    int t;
+    struct arg_s *tArgs;
+    double** parts = NULL;
+    float** parts_f = NULL;
+
+    for (unsigned int k = 0 ; k < nr_of_rooms ; k++)
+    {
+        struct room_s* room = &tb->rooms[k];
+
+        room->imp = (imp == NULL) ? NULL : imp + (uint64_t)k*nsamples*nr_of_rirs;
+        room->imp_f = (imp_f == NULL) ? NULL : imp_f + (uint64_t)k*nsamples*nr_of_rirs;
+        room->lists = (lists == NULL) ? NULL : lists + (uint64_t)k*nr_of_rirs;
+    }
+
+    // Image-parallel tasks accumulate into private, cache-line aligned copies
+    // of the output (part_alloc), which they allocate and zero themselves so
+    // that the pages are on their node; the first task uses the output
+    // itself, which no other task writes until the parts are summed. With Config::deterministic
+    // there are more parts than threads, and the tasks sum them as they
+    // finish (impMerge) instead of all of them being kept for impReduce.
+    int* merge_count = NULL;
+    int failed = 0;
+    if (image_parallel && single)
+    {
+        parts_f = new float*[nr_of_parts]();
+        parts_f[0] = imp_f;
+    }
+    else if (image_parallel)
+    {
+        parts = new double*[nr_of_parts]();
+        parts[0] = imp;
+    }
+    if (image_parallel && cfg.deterministic)
+        merge_count = new int[nr_of_parts]();
+
+    // Slabs per RIR for Config::progress
+    struct rir_progress progress;
+    std::vector<uint32_t> progress_done, progress_total;
+    if (cfg.progress != NULL)
+    {
+        progress.fn = cfg.progress;
+        progress.data = cfg.progress_data;
+        progress.nr_of_rirs = nr_of_rirs*nr_of_rooms;
+        progress.nr_of_computed = progress.nr_of_rirs;
+        if (changed != NULL)
+        {
+            progress.nr_of_computed = 0;
+            for (uint64_t rir = 0 ; rir < nr_of_rirs ; rir++)
+                progress.nr_of_computed += (changed[rir] != 0);
+        }
+        progress_done.assign(progress.nr_of_rirs, 0);
+        progress_total.assign(progress.nr_of_rirs, 0);
+        progress.done = &progress_done[0];
+        progress.total = &progress_total[0];
+        progress.inline_poll = 0;
+        progress.cancel = 0;
+        progress.next = rir_seconds() + RIR_PROGRESS_INTERVAL;
+    }
+
+    tArgs = new struct arg_s[nr_of_tasks];
+    thread_counters_.assign(numCPU, Counters());
+
+    for(t=0; t < nr_of_tasks ; t++)
+    {
+        struct room_s* room = schedule[image_parallel ? 0 : t/nr_of_rirs];
+
+        // Initialize and link all arguments to be passed to the threads
+        tArgs[t].tNum = t;
+        tArgs[t].tTot = image_parallel ? nr_of_parts : numCPU;
+
+        tArgs[t].ss = room->ss;
+        tArgs[t].rr = room->rr;
+
+        tArgs[t].L = room->L;
+        tArgs[t].beta = room->beta;
+        tArgs[t].beta_pow = room->beta_pow;
+        tArgs[t].lattice = (simd != RIR_SIMD_OFF) ? &room->lattice : NULL;
+        tArgs[t].hanning_window = tb->hanning_window;
+        tArgs[t].lpf_table = tb->lpf_table;
+        tArgs[t].lpf_oversampling = lpf_oversampling;
+        tArgs[t].simd = simd;
+        tArgs[t].single = single;
+        tArgs[t].hanning_window_f = tb->hanning_window_f;
+        tArgs[t].lpf_table_f = tb->lpf_table_f;
+        tArgs[t].lists = room->lists;
+        tArgs[t].imp = (image_parallel && !single) ? parts[t] : room->imp;
+        tArgs[t].imp_f = (image_parallel && single) ? parts_f[t] : room->imp_f;
+        tArgs[t].image_parallel = image_parallel;
+        tArgs[t].parts = parts;
+        tArgs[t].parts_f = parts_f;
+        tArgs[t].nr_of_parts = nr_of_parts;
+        tArgs[t].merge_count = merge_count;
+        tArgs[t].failed = &failed;
+        tArgs[t].rir_lo = image_parallel ? 0 : t%nr_of_rirs;
+        tArgs[t].rir_hi = image_parallel ? nr_of_rirs : t%nr_of_rirs + 1;
+        tArgs[t].fs = fs;
+        tArgs[t].cTs = cTs;
+        tArgs[t].angle = cfg.angle;
+        tArgs[t].Fc = Fc;
+        
+        tArgs[t].mtype = tb->mtype;
+        tArgs[t].directivity = (cfg.directivity != NULL) ? &tb->directivity : NULL;
+        tArgs[t].pattern = &tb->pattern[0];
+        tArgs[t].axes = (cfg.orientation != NULL) ? &tb->axes[0] : NULL;
+        tArgs[t].changed = changed;
+        tArgs[t].progress = (cfg.progress != NULL) ? &progress : NULL;
+        tArgs[t].progress_nr = (uint64_t)room->nr*nr_of_rirs;
+        
+        tArgs[t].nr_of_louds = nr_of_louds;
+        tArgs[t].nr_of_mics  = nr_of_mics;
+        tArgs[t].nsamples = nsamples;
+        tArgs[t].horizon = tb->horizon;
+        tArgs[t].tail = tail ? &room->tail : NULL;
+        tArgs[t].tail_seed = (uint64_t)room->nr*nr_of_rirs;
+        tArgs[t].tail_mismatch = 0;
+        tArgs[t].band_lattice = room->band_lattice;
+        tArgs[t].bands = bands ? &tb->filterbank : NULL;
+        
+        tArgs[t].dim_s = tb->dim_s;
+        tArgs[t].Tw = Tw;
+        tArgs[t].order = cfg.order;
+        tArgs[t].lp_filter = lp_filter;
+        tArgs[t].enumeration = cfg.enumeration;
+        tArgs[t].first_touch = cfg.first_touch;
+        tArgs[t].thread_counters = NULL;
+        RIR_COUNT(tArgs[t].thread_counters = &thread_counters_[0]);
+    } 
+
+    // Config::affinity: the threads are pinned before they touch the responses
+    Placement unpinned = { -1, -1 };
+    placement_.assign(numCPU, unpinned);
+    if (numCPU > 1)
+    {
+        std::vector<int> cpu(numCPU), node(numCPU);
+        pool_place(cfg.affinity, numCPU, &cpu[0], &node[0]);
+        for (t = 0 ; t < numCPU ; t++)
+        {
+            placement_[t].cpu = cpu[t];
+            placement_[t].node = node[t];
+        }
+    }
+
+    run_tasks(impComp, tArgs, sizeof(struct arg_s), nr_of_tasks, numCPU, (cfg.progress != NULL) ? &progress : NULL);
+    cancelled_ = (cfg.progress != NULL) && progress.cancel;
+
+    if (image_parallel)
+    {
+        // Sum the partial responses, each task taking a share of the samples,
+        // unless the tasks have summed them already, and add the tails, each
+        // task taking a share of the RIRs
+        if (merge_count == NULL && !failed)
+            run_tasks(impReduce, tArgs, sizeof(struct arg_s), nr_of_parts, numCPU, NULL);
+        if (tail && !failed)
+            run_tasks(impFinish, tArgs, sizeof(struct arg_s), nr_of_parts, numCPU, NULL);
+
+        for (t = 1 ; t < nr_of_parts ; t++)
+        {
+            if (single)
+                free(parts_f[t]);
+            else
+                free(parts[t]);
+        }
+        if (single)
+            delete [] parts_f;
+        else
+            delete [] parts;
+        delete [] merge_count;
+    }
+    if (failed)
+    {
+        delete [] tArgs;
+        throw Error("Error: Out of memory for the responses of the threads.");
+    }
+
+    // 'Original' high-pass filter as proposed by Allen and Berkley, once the
+    // responses are complete, several of them at a time in vector lanes
+    if (hp_filter == 1 && lists == NULL)
+    {
+        Counters* counters = NULL;
+        RIR_COUNT(counters = &thread_counters_[0]);
+        filter_rirs(fs, simd, imp, imp_f, nsamples, nr_of_rirs*nr_of_rooms, changed, nr_of_rirs, numCPU, counters);
+    }
+
+    tail_mismatch_ = 0;
+    for (t = 0 ; t < nr_of_tasks ; t++)
+        if (fabs(tArgs[t].tail_mismatch) > fabs(tail_mismatch_))
+            tail_mismatch_ = tArgs[t].tail_mismatch;
+
+    counters_ = Counters();
+#ifdef RIR_COUNTERS
+    for (t = 0 ; t < numCPU ; t++)
+        rir_counters_add(&counters_, thread_counters_[t]);
+#endif
+	  
+    delete [] tArgs;
+}
+
+void Generator::release(struct rir_tables* tb)
+{
+	struct room_s* rooms = tb->rooms;
+
+    delete [] tb->schedule;
+	for (unsigned int k = 0 ; k < tb->nr_of_rooms ; k++)
+	{
+		if (rooms[k].beta_pow != NULL)
+		{
+			for (int i = 0 ; i < 6 ; i++)
+				delete [] rooms[k].beta_pow[i];
+			delete [] rooms[k].beta_pow;
+		}
+		if (tb->simd != RIR_SIMD_OFF)
+			rir_lattice_free(&rooms[k].lattice);
+		if (tb->tail)
+			rir_tail_free(&rooms[k].tail);
+		if (tb->bands)
+		{
+			for (int b = 0 ; b < tb->filterbank.nr ; b++)
+				rir_lattice_free(&rooms[k].band_lattice[b]);
+			delete [] rooms[k].band_lattice;
+		}
+	}
+	if (tb->bands)
+		rir_bands_free(&tb->filterbank);
+	delete [] rooms;
+	delete [] tb->hanning_window;
+	if (tb->lpf_table != NULL)
+		delete [] tb->lpf_table;
+	if (tb->single)
+	{
+		delete [] tb->hanning_window_f;
+		if (tb->lpf_table_f != NULL)
+			delete [] tb->lpf_table_f;
+	}
+	delete tb;
+}
+
+Session::Session(const Config& config, const Room& room, unsigned int nr_of_mics, unsigned int nr_of_louds)
+	: gen_(config), tables_(NULL), nr_of_mics_(nr_of_mics), nr_of_louds_(nr_of_louds)
+{
+	Config& cfg = gen_.config_;
+
+	if (nr_of_mics == 0 || nr_of_louds == 0 || cfg.nsamples == 0)
+		throw Error("Invalid input arguments!");
+
+	// The directivity is read by every update; the orientation and the types
+	// are kept so that config() stays valid.
+	if (cfg.directivity != NULL)
+	{
+		directivity_.assign(cfg.directivity, cfg.directivity +
+			(size_t)cfg.directivity_el*cfg.directivity_az*cfg.directivity_bands);
+		cfg.directivity = &directivity_[0];
+	}
+	if (cfg.orientation != NULL)
+	{
+		orientation_.assign(cfg.orientation, cfg.orientation + (size_t)cfg.orientation_rows*cfg.orientation_cols);
+		cfg.orientation = &orientation_[0];
+	}
+	if (cfg.mtypes != NULL)
+	{
+		mtypes_.assign(cfg.mtypes, cfg.mtypes + nr_of_mics);
+		cfg.mtypes = &mtypes_[0];
+	}
+
+	// The responses that are recomputed are zeroed by update()
+	cfg.first_touch = 0;
+
+	r_.assign(room.r, room.r + 3*(size_t)nr_of_mics);
+	s_.assign(room.s, room.s + 3*(size_t)nr_of_louds);
+	h_.assign((size_t)cfg.nsamples*nr_of_mics*nr_of_louds, 0);
+	h_prev_.assign(h_.size(), 0);
+	changed_.assign((size_t)nr_of_mics*nr_of_louds, 1);
+
+	tables_ = gen_.prepare(&room, 1, nr_of_mics, nr_of_louds, 0, 0, 0);
+	tables_->rooms[0].rr = &r_[0];
+	tables_->rooms[0].ss = &s_[0];
+
+	// The destructor does not run when the constructor throws
+	try
+	{
+		gen_.execute(tables_, &h_[0], NULL, NULL, NULL);
+	}
+	catch (...)
+	{
+		Generator::release(tables_);
+		throw;
+	}
+}
+
+Session::~Session()
+{
+	Generator::release(tables_);
+}
+
+uint64_t Session::update(const double* r, const double* s)
+{
+	const uint64_t nsamples = gen_.config_.nsamples;
+	uint64_t       nr_of_changes = 0;
+	std::vector<double> r_prev(r_), s_prev(s_);
+
+	// The responses of the pairs that moved are computed again from zero, the
+	// others are kept
+	h_prev_ = h_;
+	for (unsigned int n = 0 ; n < nr_of_louds_ ; n++)
+		for (unsigned int m = 0 ; m < nr_of_mics_ ; m++)
+		{
+			uint64_t rir = (uint64_t)n*nr_of_mics_ + m;
+
+			changed_[rir] = 0;
+			for (int i = 0 ; i < 3 ; i++)
+				if (r[m + i*nr_of_mics_] != r_[m + i*nr_of_mics_] || s[n + i*nr_of_louds_] != s_[n + i*nr_of_louds_])
+					changed_[rir] = 1;
+			if (changed_[rir])
+			{
+				memset(&h_[rir*nsamples], 0, nsamples*sizeof(double));
+				nr_of_changes++;
+			}
+		}
+	if (r != &r_[0])
+		r_.assign(r, r + 3*(size_t)nr_of_mics_);
+	if (s != &s_[0])
+		s_.assign(s, s + 3*(size_t)nr_of_louds_);
+
+	gen_.cancelled_ = 0;
+	if (nr_of_changes > 0)
+		gen_.execute(tables_, &h_[0], NULL, NULL, &changed_[0]);
+
+	// A cancelled update leaves partial responses; go back to the positions
+	// before it, so that the next update recomputes the pairs that moved
+	if (gen_.cancelled())
+	{
+		h_ = h_prev_;
+		r_.assign(r_prev.begin(), r_prev.end());
+		s_.assign(s_prev.begin(), s_prev.end());
+		return 0;
+	}
+	return nr_of_changes;
+}
+
+void Session::set_progress(int (*progress)(double fraction, void* data), void* data)
+{
+	gen_.config_.progress = progress;
+	gen_.config_.progress_data = data;
+}
+
+void Session::delta(double* h) const
+{
+	for (size_t i = 0 ; i < h_.size() ; i++)
+		h[i] = h_[i] - h_prev_[i];
+}
+
+void Session::crossfade(double a, double* h) const
+{
+	for (size_t i = 0 ; i < h_.size() ; i++)
+		h[i] = h_prev_[i] + a*(h_[i] - h_prev_[i]);
+}
+
+Convolver::Convolver(const double* h, unsigned int nsamples, unsigned int nr_of_mics, unsigned int nr_of_louds,
+	unsigned int block_size, int num_threads)
+	: fft_(NULL), nsamples_(nsamples), nr_of_mics_(nr_of_mics), nr_of_louds_(nr_of_louds),
+	  block_size_(block_size), num_threads_(num_threads), block_(0)
+{
+	if (nsamples == 0 || nr_of_mics == 0 || nr_of_louds == 0 || num_threads < 0 ||
+		block_size == 1 || (block_size & (block_size-1)) != 0 || block_size > (1u << 30))
+		throw Error("Invalid input arguments!");
+	if (block_size_ == 0)
+		for (block_size_ = 2 ; block_size_ < nsamples && block_size_ < 8192 ; block_size_ *= 2) ;
+
+	if (num_threads_ == 0)
+		num_threads_ = sysconf( _SC_NPROCESSORS_ONLN );
+	if (num_threads_ > 1 && pool_start(num_threads_))
+		throw Error("Problem with creating the thread (pthread_create).");
+
+	const uint64_t S = 2*(block_size_+1);
+
+	nr_of_parts_ = (nsamples + block_size_ - 1)/block_size_;
+	fft_ = new struct rir_fft;
+	rir_fft_build(fft_, 2*block_size_);
+	spectra_.assign((uint64_t)nr_of_louds*nr_of_mics*nr_of_parts_*S, 0);
+	last_.assign((uint64_t)nr_of_louds*block_size_, 0);
+	history_.assign((uint64_t)nr_of_louds*nr_of_parts_*S, 0);
+	set_responses(h);
+}
+
+Convolver::~Convolver()
+{
+	rir_fft_free(fft_);
+	delete fft_;
+}
+
+void Convolver::set_responses(const double* h)
+{
+	const unsigned int B = block_size_;
+	const uint64_t     S = 2*(B+1);
+	std::vector<double> frame(2*B, 0);
+	std::vector<double> z(2*B);
+
+	// The factor 1/B of the inverse FFTs is applied here, once
+	for (uint64_t rir = 0 ; rir < (uint64_t)nr_of_louds_*nr_of_mics_ ; rir++)
+		for (unsigned int p = 0 ; p < nr_of_parts_ ; p++)
+		{
+			double* H = &spectra_[(rir*nr_of_parts_ + p)*S];
+
+			for (unsigned int i = 0 ; i < B ; i++)
+				frame[i] = (p*B + i < nsamples_) ? h[rir*nsamples_ + p*B + i]/B : 0;
+			rir_fft_forward(fft_, &frame[0], H, &z[0]);
+		}
+}
+
+void Convolver::process(const double* x, double* y)
+{
+	const unsigned int B = block_size_;
+	const uint64_t     S = 2*(B+1);
+	const int          nr_of_tasks = nr_of_mics_;
+	const int          numCPU = (num_threads_ < nr_of_tasks) ? num_threads_ : nr_of_tasks;
+	std::vector<double> frame(2*B);
+	std::vector<double> z(2*B);
+
+	for (unsigned int n = 0 ; n < nr_of_louds_ ; n++)
+	{
+		memcpy(&frame[0], &last_[(uint64_t)n*B], B*sizeof(double));
+		memcpy(&frame[B], x + (uint64_t)n*B, B*sizeof(double));
+		rir_fft_forward(fft_, &frame[0], &history_[((uint64_t)n*nr_of_parts_ + block_ % nr_of_parts_)*S], &z[0]);
+		memcpy(&last_[(uint64_t)n*B], x + (uint64_t)n*B, B*sizeof(double));
+	}
+
+	std::vector<struct conv_s> tArgs(nr_of_tasks);
+	for (int t = 0 ; t < nr_of_tasks ; t++)
+	{
+		struct conv_s* a = &tArgs[t];
+		a->fft = fft_;
+		a->block_size = B;
+		a->nr_of_mics = nr_of_mics_;
+		a->nr_of_louds = nr_of_louds_;
+		a->nr_of_parts = nr_of_parts_;
+		a->H = &spectra_[0];
+		a->X = &history_[0];
+		a->nr_of_slots = nr_of_parts_;
+		a->x = NULL;
+		a->y = y;
+		a->length = B;
+		a->first = block_;
+		a->mic = t;
+		a->begin = block_;
+		a->end = block_ + 1;
+	}
+	run_tasks(convBlocks, &tArgs[0], sizeof(struct conv_s), nr_of_tasks, numCPU, NULL);
+	block_++;
+}
+
+void Convolver::reset()
+{
+	last_.assign(last_.size(), 0);
+	history_.assign(history_.size(), 0);
+	block_ = 0;
+}
+
+void Convolver::convolve(const double* x, uint64_t length, double* y) const
+{
+	const unsigned int B = block_size_;
+	const uint64_t     S = 2*(B+1);
+	const uint64_t     K = (length + B - 1)/B;
+	int                numCPU = num_threads_;
+
+	if (length == 0)
+		return;
+
+	// All spectra of the input first, N*K blocks in numCPU tasks, then the
+	// output blocks of every receiver in chunks, so that there are tasks for
+	// all threads also with fewer receivers than threads.
+	std::vector<double> X(nr_of_louds_*K*S);
+	uint64_t nr_of_spectra = nr_of_louds_*K;
+	int      nr_of_tasks = (nr_of_spectra < (uint64_t)numCPU) ? (int)nr_of_spectra : numCPU;
+	std::vector<struct conv_s> tArgs(nr_of_tasks);
+	for (int t = 0 ; t < nr_of_tasks ; t++)
+	{
+		struct conv_s* a = &tArgs[t];
+		a->fft = fft_;
+		a->block_size = B;
+		a->X = &X[0];
+		a->nr_of_slots = K;
+		a->x = x;
+		a->length = length;
+		a->begin = nr_of_spectra*t/nr_of_tasks;
+		a->end = nr_of_spectra*(t+1)/nr_of_tasks;
+	}
+	run_tasks(convSpectra, &tArgs[0], sizeof(struct conv_s), nr_of_tasks, nr_of_tasks, NULL);
+
+	uint64_t nr_of_chunks = (numCPU > 1) ? (2*(uint64_t)numCPU + nr_of_mics_ - 1)/nr_of_mics_ : 1;
+	if (nr_of_chunks > K)
+		nr_of_chunks = K;
+	nr_of_tasks = nr_of_mics_*nr_of_chunks;
+	if (numCPU > nr_of_tasks)
+		numCPU = nr_of_tasks;
+	tArgs.resize(nr_of_tasks);
+	for (int t = 0 ; t < nr_of_tasks ; t++)
+	{
+		struct conv_s* a = &tArgs[t];
+		uint64_t       c = t % nr_of_chunks;
+		a->fft = fft_;
+		a->block_size = B;
+		a->nr_of_mics = nr_of_mics_;
+		a->nr_of_louds = nr_of_louds_;
+		a->nr_of_parts = nr_of_parts_;
+		a->H = &spectra_[0];
+		a->X = &X[0];
+		a->nr_of_slots = K;
+		a->x = NULL;
+		a->y = y;
+		a->length = length;
+		a->first = 0;
+		a->mic = t / nr_of_chunks;
+		a->begin = K*c/nr_of_chunks;
+		a->end = K*(c+1)/nr_of_chunks;
+	}
+	run_tasks(convBlocks, &tArgs[0], sizeof(struct conv_s), nr_of_tasks, numCPU, NULL);
+}
+
+double beta_from_t60(double c, const double* L, double T60)
+{
+	double V = L[0]*L[1]*L[2];
+	double S = 2*(L[0]*L[2]+L[1]*L[2]+L[0]*L[1]);
+	double alfa = 24*V*log(10.0)/(c*S*T60);
+
+	if (alfa > 1)
+		throw Error("Error: The reflection coefficients cannot be calculated using the current "
+			"room parameters, i.e. room size and reverberation time.\n           Please "
+			"specify the reflection coefficients or change the room parameters.");
+	return sqrt(1-alfa);
+}
+
+double t60_from_beta(double c, const double* L, const double* beta_in, const int* dim)
+{
+	double beta[6];
+	double TR;
+
+	for (int i = 0 ; i < 6 ; i++)
+		beta[i] = (dim[i/2] == 0) ? 0 : beta_in[i];
+
+	double V = L[0]*L[1]*L[2];
+	double alpha = ((1-pow(beta[0],2))+(1-pow(beta[1],2)))*L[0]*L[2] +
+		((1-pow(beta[2],2))+(1-pow(beta[3],2)))*L[1]*L[2] +
+		((1-pow(beta[4],2))+(1-pow(beta[5],2)))*L[0]*L[1];
+	TR = 24*log(10.0)*V/(c*alpha);
+	if (TR < 0.128)
+		TR = 0.128;
+	return TR;
+}
+
+// Resolves the simd level and the threads of hp_filter and starts the pool.
+static void hp_filter_setup(double fs, int* simd, int* num_threads)
+{
+	if (fs <= 0 || *num_threads < 0)
+		throw Error("Invalid input arguments!");
+	if (*simd < SIMD_OFF || *simd > SIMD_AUTO)
+		throw Error("Error: options.simd must be 'auto', 'avx512', 'avx2', 'sse2', 'scalar' or 'off'.");
+	if (*simd != SIMD_AUTO && !rir_simd_supported(*simd))
+		throw Error("Error: the instruction set in options.simd is not supported by this CPU.");
+	if (*simd == SIMD_AUTO)
+		*simd = rir_simd_parse("auto");
+	if (*num_threads == 0)
+		*num_threads = sysconf( _SC_NPROCESSORS_ONLN );
+	if (*num_threads > 1 && pool_start(*num_threads))
+		throw Error("Problem with creating the thread (pthread_create).");
+}
+
+void hp_filter(double* h, unsigned int nsamples, uint64_t count, double fs, int simd, int num_threads)
+{
+	hp_filter_setup(fs, &simd, &num_threads);
+	filter_rirs(fs, simd, h, NULL, nsamples, count, NULL, count, num_threads, NULL);
+}
+
+void hp_filter(float* h, unsigned int nsamples, uint64_t count, double fs, int simd, int num_threads)
+{
+	hp_filter_setup(fs, &simd, &num_threads);
+	filter_rirs(fs, simd, NULL, h, nsamples, count, NULL, count, num_threads, NULL);
+}
+
+int parse_enumeration(const char* name, int* enumeration)
+{
+	if (strcmp(name, "box") == 0)
+		*enumeration = ENUM_BOX;
+	else if (strcmp(name, "sphere") == 0)
+		*enumeration = ENUM_SPHERE;
+	else
+		return 0;
+	return 1;
+}
+
+int parse_simd(const char* name, int* simd)
+{
+	if (strcmp(name, "auto") == 0)
+		*simd = SIMD_AUTO;
+	else if ((*simd = rir_simd_parse(name)) == -2)
+		return 0;
+	return 1;
+}
+
+int parse_parallel(const char* name, int* parallel)
+{
+	if (strcmp(name, "auto") == 0)
+		*parallel = PARALLEL_AUTO;
+	else if (strcmp(name, "mic") == 0)
+		*parallel = PARALLEL_MIC;
+	else if (strcmp(name, "image") == 0)
+		*parallel = PARALLEL_IMAGE;
+	else
+		return 0;
+	return 1;
+}
+
+int parse_affinity(const char* name, int* affinity)
+{
+	if (strcmp(name, "none") == 0)
+		*affinity = AFFINITY_NONE;
+	else if (strcmp(name, "compact") == 0)
+		*affinity = AFFINITY_COMPACT;
+	else if (strcmp(name, "scatter") == 0)
+		*affinity = AFFINITY_SCATTER;
+	else
+		return 0;
+	return 1;
+}
+
+void shutdown_threads()
+{
+	pool_shutdown();
+}
+
+const char* counter_timer()
+{
+#if !defined(RIR_COUNTERS)
+	return NULL;
+#elif defined(RIR_SIMD_X86)
+	return "tsc";
+#else
+	return "ns";
+#endif
+}
+
+}
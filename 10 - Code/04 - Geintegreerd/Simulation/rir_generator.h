@@ -0,0 +1,439 @@
+/*
+Program     : Room Impulse Response Generator - library interface
+
+Description : The image-method engine [1,2] of rir_generator_x.cpp and
+              rir_generator_x_threaded.cpp without MATLAB, so that it can be
+              used from C++ programs such as rir_generator_cli.cpp. The MEX
+              files only translate their arguments into a rir::Config and
+              rir::Room's (rir_generator_mex.h) and call rir::Generator.
+
+              [1] J.B. Allen and D.A. Berkley,
+              Image method for efficiently simulating small-room Acoustics,
+              Journal Acoustic Society of America, 65(4), April 1979, p 943.
+
+              [2] P.M. Peterson,
+              Simulating the response of multiple microphones to a single
+              acoustic source in a reverberant room, Journal Acoustic
+              Society of America, 80(5), November 1986.
+
+              Build (the engine uses pthreads):
+                g++ -O2 -pthread -c rir_generator.cpp
+              and link rir_generator.o into the program. The MEX files are
+              compiled together with rir_generator.cpp, see their headers.
+*/
+
+#ifndef RIR_GENERATOR_H
+#define RIR_GENERATOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdexcept>
+#include <vector>
+
+struct rir_image_list;
+struct rir_tables;
+struct rir_fft;
+
+namespace rir
+{
+
+// Invalid settings and failures while computing, with the same messages as
+// the MEX files.
+class Error : public std::runtime_error
+{
+public:
+	explicit Error(const char* msg) : std::runtime_error(msg) {}
+};
+
+enum Enumeration { ENUM_BOX = 0, ENUM_SPHERE = 1 };
+
+// The levels match RIR_SIMD_* in rir_simd.h; SIMD_AUTO is the widest one the
+// CPU supports.
+enum Simd { SIMD_OFF = -1, SIMD_SCALAR = 0, SIMD_SSE2 = 1, SIMD_AVX2 = 2, SIMD_AVX512 = 3, SIMD_AUTO = 4 };
+
+enum Parallel { PARALLEL_AUTO = 0, PARALLEL_MIC = 1, PARALLEL_IMAGE = 2 };
+
+// The levels match RIR_AFFINITY_* in rir_numa.h.
+enum Affinity { AFFINITY_NONE = 0, AFFINITY_COMPACT = 1, AFFINITY_SCATTER = 2 };
+
+// Settings shared by all rooms of a call. The defaults are those of the MEX
+// files, except for nsamples which has to be set.
+struct Config
+{
+	double        c;                // sound velocity in m/s
+	double        fs;               // sampling frequency in Hz
+	unsigned int  nsamples;         // length of the responses
+	char          mtype;            // 'o', 's', 'c', 'h' or 'b'
+	int           order;            // reflection order, -1 for all
+	int           dim[3];           // axes of the room that are used (0/1)
+	double        angle;            // microphone orientation in rad
+	int           hp_filter;
+	int           lp_filter;
+	double        window_l;         // length of the LPF window in s
+
+	int           enumeration;      // Enumeration
+	int           gain_tables;
+	int           lpf_oversampling; // 0 = exact LPF kernel
+	int           simd;             // Simd
+	int           parallel;         // Parallel
+	int           num_threads;      // 0 = number of cores, 1 = calling thread only
+	int           deterministic;    // see Generator::compute
+	int           affinity;         // Affinity, see Generator::placement()
+	int           first_touch;      // see Generator::compute
+	int           max_images;       // cap per list for the image lists, 0 = none
+	double        transition;       // s after which the tail is stochastic, 0 = off
+	int           nr_of_bands;      // octave bands of Room::band_beta, 0 = broadband beta
+	double        band_fc;          // centre frequency of the first band in Hz
+
+	// Measured receiver directivity instead of mtype: gains on a uniform grid
+	// of directivity_el polar angles pi*e/(E-1) from the z axis and
+	// directivity_az azimuths 2*pi*a/A from the orientation angle, stored
+	// E x A x directivity_bands as in MATLAB, with 1 page or one per octave
+	// band. Not copied, it has to outlive the Generator.
+	const double* directivity;      // NULL = mtype
+	int           directivity_az;
+	int           directivity_el;
+	int           directivity_bands;
+
+	// Full 3-D orientation of the receivers instead of angle: one row for all
+	// receivers or one per receiver, stored as in MATLAB, with
+	// orientation_cols = 3 for [yaw pitch roll] in rad, the rotation
+	// Rz(yaw)*Ry(pitch)*Rx(roll) of the room axes, or 4 for a quaternion
+	// [w x y z]. A receiver points along its rotated x axis and mtype is
+	// applied to the 3-D direction of the images. Not copied.
+	const double* orientation;      // NULL = angle
+	int           orientation_rows;
+	int           orientation_cols;
+	const char*   mtypes;           // one mtype per receiver, NULL = mtype for all
+
+	// Called by the thread that called compute() about every 0.1 s while the
+	// images are added, with the fraction of the image slabs done over all
+	// responses. Returning nonzero cancels the call: the remaining slabs are
+	// skipped, the responses are partial and Generator::cancelled() is true.
+	int           (*progress)(double fraction, void* data);  // NULL = none
+	void*         progress_data;
+
+	Config()
+		: c(343), fs(16000), nsamples(0), mtype('o'), order(-1), angle(0),
+		  hp_filter(1), lp_filter(1), window_l(0.008), enumeration(ENUM_SPHERE),
+		  gain_tables(1), lpf_oversampling(0), simd(SIMD_AUTO), parallel(PARALLEL_AUTO),
+		  num_threads(0), deterministic(0), affinity(AFFINITY_NONE), first_touch(0), max_images(0),
+		  transition(0), nr_of_bands(0), band_fc(125), directivity(NULL), directivity_az(0),
+		  directivity_el(0), directivity_bands(1), orientation(NULL), orientation_rows(0),
+		  orientation_cols(0), mtypes(NULL), progress(NULL), progress_data(NULL)
+	{
+		dim[0] = dim[1] = dim[2] = 1;
+	}
+};
+
+// One room: its dimensions and reflection coefficients, and the receivers
+// r and sources s stored as for MATLAB, [x_1 .. x_M y_1 .. y_M z_1 .. z_M].
+// All rooms of a call have the same numbers of receivers and sources. With
+// Config::nr_of_bands the coefficients come from band_beta, the 6 of band b
+// at band_beta + 6*b, in the octave bands band_fc*2^b, and beta is not used.
+struct Room
+{
+	double        L[3];             // room dimensions in m
+	double        beta[6];          // [beta_x1 beta_x2 beta_y1 beta_y2 beta_z1 beta_z2]
+	const double* band_beta;        // 6 x nr_of_bands, only read with Config::nr_of_bands
+	const double* r;
+	const double* s;
+};
+
+// Memory held by the tables that are built once per call.
+struct TableBytes
+{
+	size_t        lattice;
+	size_t        gains;
+	size_t        lpf;
+	size_t        tail;             // envelopes of the late reverberation
+	size_t        filterbank;       // lowpass filters combining the octave bands
+};
+
+// Work done by the last compute(), counted only when rir_generator.cpp is
+// compiled with -DRIR_COUNTERS and zero otherwise. Visited images are those
+// whose distance was computed; each is then rejected by the reflection order,
+// rejected by its distance (nsamples) or accepted. The cycles are timer ticks,
+// see counter_timer(); the image enumeration itself is the rest of
+// cycles_total.
+struct Counters
+{
+	uint64_t      tasks;            // RIRs (mic-parallel) or image slabs (image-parallel)
+	uint64_t      images_visited;
+	uint64_t      images_rejected_order;
+	uint64_t      images_rejected_distance;
+	uint64_t      images_accepted;
+	uint64_t      taps_written;     // output samples updated by the accepted images
+	uint64_t      cycles_total;     // all tasks
+	uint64_t      cycles_images;    // distances and gains of the image columns (vectorized path)
+	uint64_t      cycles_lpf;       // fractional delay kernels
+	uint64_t      cycles_scatter;   // adding the pulses to the responses or lists
+	uint64_t      cycles_hp_filter;
+	uint64_t      cycles_reduce;    // summing the image-parallel partial responses
+	uint64_t      cycles_filterbank; // combining the octave-band responses
+};
+
+// CPU and NUMA node of a worker thread, -1 when it is not pinned.
+struct Placement
+{
+	int           cpu;
+	int           node;
+};
+
+class Generator
+{
+public:
+	// Throws Error when the settings cannot be used on this machine.
+	explicit Generator(const Config& config);
+
+	const Config& config() const { return config_; }
+
+	// Computes the nsamples x M x N responses of each of the K rooms into h,
+	// stored as nsamples x M x N x K and zero on entry. The float version
+	// computes in single precision. With Config::first_touch h need not be
+	// zero: every task zeroes the responses it computes before it adds the
+	// images, so that on Linux their pages are placed on the NUMA node of the
+	// thread writing them, provided that h was not written since it was
+	// allocated (malloc rather than calloc).
+	//
+	// Mic-parallel, every response is computed by one thread in the order of
+	// rir_generator_x.cpp, with the same result. Image-parallel, the threads
+	// add their share of the images to partial responses that are summed
+	// afterwards, so the rounding depends on the number of threads. With
+	// Config::deterministic the images are split into a fixed number of
+	// partial responses instead, summed in a fixed order as the tasks
+	// finish, and PARALLEL_AUTO chooses between the two from the number of
+	// responses only, so that the result is the same for every num_threads
+	// (though not for every Parallel). Even on one thread that result is a
+	// sum of 16 partial responses, so it differs from the mic-parallel one
+	// by rounding; it is not made bit-identical to it.
+	void compute(const Room* rooms, unsigned int nr_of_rooms, unsigned int nr_of_mics,
+		unsigned int nr_of_louds, double* h);
+	void compute(const Room* rooms, unsigned int nr_of_rooms, unsigned int nr_of_mics,
+		unsigned int nr_of_louds, float* h);
+
+	// Collects the images that arrive within nsamples per receiver, source and
+	// room into the M x N x K lists, initialized with rir_image_list_init.
+	void compute(const Room* rooms, unsigned int nr_of_rooms, unsigned int nr_of_mics,
+		unsigned int nr_of_louds, struct rir_image_list* lists);
+
+	// Computes the responses into the file path instead of memory, float32 or
+	// float64 samples in the layout of rir_file.h. The threads write into a
+	// shared mapping of the file, so the responses may be larger than the
+	// memory. The file is marked complete unless Config::progress cancelled
+	// the call. Throws Error when it cannot be created or written.
+	void compute_file(const Room* rooms, unsigned int nr_of_rooms, unsigned int nr_of_mics,
+		unsigned int nr_of_louds, const char* path, bool single);
+
+	// Tables of the last compute().
+	const TableBytes& table_bytes() const { return table_bytes_; }
+
+	// Counters of the last compute(), in total and per thread (one entry per
+	// thread used, the first one being the calling thread when it computes
+	// alone).
+	const Counters& counters() const { return counters_; }
+	const std::vector<Counters>& thread_counters() const { return thread_counters_; }
+
+	// With Config::transition: the largest deviation in dB, over the
+	// responses of the last compute(), of the energy of the exact part from
+	// the decay of the fitted tail in the window before the fit. A few dB
+	// mean that the reflections are not yet diffuse at the transition.
+	double tail_mismatch() const { return tail_mismatch_; }
+
+	// Whether Config::progress cancelled the last compute().
+	bool cancelled() const { return cancelled_ != 0; }
+
+	// Where the threads of the last compute() ran, one entry per thread as
+	// for thread_counters(): the CPU they were pinned to for Config::affinity
+	// and its NUMA node, or -1 when they were not pinned (AFFINITY_NONE, one
+	// thread, or no pinning on this system).
+	const std::vector<Placement>& placement() const { return placement_; }
+
+private:
+	friend class Session;
+
+	void run(const Room* rooms, unsigned int nr_of_rooms, unsigned int nr_of_mics,
+		unsigned int nr_of_louds, double* imp, float* imp_f, struct rir_image_list* lists);
+
+	// run() in three steps: the tables that do not depend on the positions of
+	// the receivers and sources, the responses at the positions of the rooms,
+	// and freeing the tables.
+	struct rir_tables* prepare(const Room* rooms, unsigned int nr_of_rooms, unsigned int nr_of_mics,
+		unsigned int nr_of_louds, int single, int images, int mapped);
+	void execute(struct rir_tables* tables, double* imp, float* imp_f, struct rir_image_list* lists,
+		const unsigned char* changed);
+	static void release(struct rir_tables* tables);
+
+	Config        config_;
+	int           simd_;
+	TableBytes    table_bytes_;
+	Counters      counters_;
+	std::vector<Counters> thread_counters_;
+	double        tail_mismatch_;
+	int           cancelled_;
+	std::vector<Placement> placement_;
+};
+
+// One room whose receivers and sources move, such as phones tracked during a
+// recording. The image lattice, the wall gain tables, the LPF kernels and the
+// envelopes of the tail do not depend on the positions and are built once;
+// an update only recomputes the responses of the receiver-source pairs of
+// which one moved, in double precision.
+class Session
+{
+public:
+	// Computes the responses at the positions room.r and room.s. The room is
+	// only read here and the arrays of the config are copied, so the Session
+	// may outlive them.
+	Session(const Config& config, const Room& room, unsigned int nr_of_mics, unsigned int nr_of_louds);
+	~Session();
+
+	// Moves the receivers and sources to r and s, stored as for Room (or
+	// receivers() and sources() to keep them), and recomputes the responses of
+	// the pairs of which one moved. Returns their number. When Config::progress
+	// cancels the update, the session stays at the positions and responses
+	// before it, generator().cancelled() is true and 0 is returned.
+	uint64_t update(const double* r, const double* s);
+
+	// Replaces Config::progress and Config::progress_data for the next
+	// updates, such as a callback with the state of one call.
+	void set_progress(int (*progress)(double fraction, void* data), void* data);
+
+	unsigned int nr_of_mics() const { return nr_of_mics_; }
+	unsigned int nr_of_louds() const { return nr_of_louds_; }
+
+	// The positions of the last update, stored as for Room.
+	const double* receivers() const { return &r_[0]; }
+	const double* sources() const { return &s_[0]; }
+
+	// The nsamples x M x N responses after and before the last update.
+	const double* response() const { return &h_[0]; }
+	const double* previous() const { return &h_prev_[0]; }
+
+	// Writes the change of the responses by the last update into h.
+	void delta(double* h) const;
+
+	// Writes (1-a)*previous() + a*response() into h; a going from 0 to 1 over
+	// a block of a time-varying simulation fades from the old to the new
+	// responses.
+	void crossfade(double a, double* h) const;
+
+	// Tables and counters of the engine; the counters are those of the last
+	// computation, the constructor or an update in which something moved.
+	const Generator& generator() const { return gen_; }
+
+private:
+	Session(const Session&);
+	Session& operator=(const Session&);
+
+	Generator     gen_;
+	struct rir_tables* tables_;
+	unsigned int  nr_of_mics_;
+	unsigned int  nr_of_louds_;
+	std::vector<double> r_;
+	std::vector<double> s_;
+	std::vector<double> directivity_;
+	std::vector<double> orientation_;
+	std::vector<char> mtypes_;
+	std::vector<double> h_;
+	std::vector<double> h_prev_;
+	std::vector<unsigned char> changed_;
+};
+
+// The signals of the receivers for source signals played in the room: the
+// convolution of the sources with the nsamples x M x N responses of a
+// Generator or Session, summed over the sources. Uniformly partitioned
+// overlap-save: every response is cut into P = ceil(nsamples/block_size)
+// blocks whose spectra are computed once, so that a block of output costs
+// an FFT per source, an inverse FFT per receiver and M x N x P products of
+// spectra, with a latency of block_size samples.
+class Convolver
+{
+public:
+	// h is only read here. block_size is a power of two of at least 2, or 0
+	// for the smallest one of at least nsamples (at most 8192), which suits
+	// convolve(). num_threads as for Config, 0 for all cores.
+	Convolver(const double* h, unsigned int nsamples, unsigned int nr_of_mics, unsigned int nr_of_louds,
+		unsigned int block_size, int num_threads = 0);
+	~Convolver();
+
+	// Replaces the responses, e.g. by those of a Session after an update. The
+	// history of process() is kept, so the output changes from the next block.
+	void set_responses(const double* h);
+
+	// Streaming: takes the next block_size samples of every source, x stored
+	// as block_size x N, and writes the next block_size samples of every
+	// receiver into y, block_size x M. Parallel over the receivers.
+	void process(const double* x, double* y);
+
+	// Forgets the sources given to process().
+	void reset();
+
+	// Offline: writes the first length samples of the receiver signals for
+	// the whole source signals x (length x N) into y (length x M), as fftfilt
+	// per response. Parallel over the receivers and blocks; independent of
+	// process().
+	void convolve(const double* x, uint64_t length, double* y) const;
+
+	unsigned int block_size() const { return block_size_; }
+	unsigned int nr_of_mics() const { return nr_of_mics_; }
+	unsigned int nr_of_louds() const { return nr_of_louds_; }
+
+private:
+	Convolver(const Convolver&);
+	Convolver& operator=(const Convolver&);
+
+	struct rir_fft* fft_;
+	unsigned int  nsamples_;
+	unsigned int  nr_of_mics_;
+	unsigned int  nr_of_louds_;
+	unsigned int  block_size_;
+	unsigned int  nr_of_parts_;
+	int           num_threads_;
+	std::vector<double> spectra_;       // of the response blocks
+	std::vector<double> last_;          // the last block of every source
+	std::vector<double> history_;       // spectra of the last P input blocks
+	uint64_t      block_;               // blocks given to process()
+};
+
+// Reflection coefficient of all walls that gives the reverberation time T60
+// (Sabine) in a room of dimensions L. Throws Error when there is none.
+double beta_from_t60(double c, const double* L, double T60);
+
+// Reverberation time (Sabine) of a room, at least 0.128 s, with the walls of
+// the axes that are not used counted as absorbing.
+double t60_from_beta(double c, const double* L, const double* beta, const int* dim);
+
+// The 'original' high-pass filter of Allen and Berkley that Config::hp_filter
+// applies, in place on count responses of nsamples samples stored one after
+// the other, e.g. responses computed with hp_filter = 0 or measured ones.
+// The responses are filtered several at a time in the vector lanes of the
+// level simd, with the same result as one at a time. num_threads as for
+// Config.
+void hp_filter(double* h, unsigned int nsamples, uint64_t count, double fs, int simd = SIMD_AUTO,
+	int num_threads = 0);
+void hp_filter(float* h, unsigned int nsamples, uint64_t count, double fs, int simd = SIMD_AUTO,
+	int num_threads = 0);
+
+// Names of the settings as used by the MEX options and the CLI room spec.
+// Return 0 for an unknown name.
+int parse_enumeration(const char* name, int* enumeration);
+int parse_simd(const char* name, int* simd);
+int parse_parallel(const char* name, int* parallel);
+int parse_affinity(const char* name, int* affinity);
+
+// The worker threads are kept across calls; this stops them. There is one
+// pool of them per process: Generators, Sessions, Convolvers and hp_filter
+// may be used from different threads at the same time, but their threaded
+// parts take turns on the pool rather than running side by side. A
+// Config::progress function must therefore not start another call itself.
+void shutdown_threads();
+
+// Unit of the cycle counters: "tsc" (time stamp counter ticks) on x86, "ns"
+// elsewhere, and NULL when rir_generator.cpp is compiled without
+// -DRIR_COUNTERS.
+const char* counter_timer();
+
+}
+
+#endif
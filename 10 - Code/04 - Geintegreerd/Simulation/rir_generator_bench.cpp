@@ -0,0 +1,241 @@
+/*
+Program     : Room Impulse Response Generator - benchmark
+
+Description : Times rir::Generator over a matrix of rooms and settings and
+              prints one CSV (or JSON) record per case, so that runs of
+              different versions can be compared. Each case is run in the
+              serial mode of rir_generator_x (one thread, no pool) and in the
+              threaded mode of rir_generator_x_threaded for every thread
+              count given.
+
+              The room is a 5 x 4 x 3 m box scaled by each of the scales, with
+              the receivers 5 cm apart around 0.3*L and the sources 5 cm apart
+              around 0.7*L. The reflection coefficients follow from T60, and
+              nsample is T60*fs unless given.
+
+              Build (the counters of visited and accepted images need
+              -DRIR_COUNTERS, without it they are reported as 0):
+                g++ -O2 -pthread -DRIR_COUNTERS rir_generator_bench.cpp rir_generator.cpp -o rir_generator_bench
+
+              Usage:
+                rir_generator_bench [--name=a,b,...] ...
+
+              with the lists (defaults in brackets)
+                --scales      room scale factors           [0.5,1,2]
+                --t60         reverberation times in s     [0.2,0.5]
+                --nsample     response lengths, 0 = T60*fs [0]
+                --mics        numbers of receivers         [1,4]
+                --sources     numbers of sources           [1]
+                --window_l    LPF window lengths in s      [0.004,0.008]
+                --lp_filter   0 and/or 1                   [0,1]
+                --threads     threaded mode thread counts  [number of cores]
+              and
+                --fs=16000 --reps=3 --format=csv|json
+
+              Columns: mode, threads, L (m), volume (m^3), T60, beta, nsample,
+              mics, sources, window_l (only the first one without the LPF),
+              lp_filter, reps, the minimum and median time of the reps in ms,
+              images visited and accepted, ns per accepted image (median
+              time) and the speed-up of the median time over the serial mode.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+#include <algorithm>
+#include "rir_generator.h"
+
+static int parse_list(const char* arg, const char* name, std::vector<double>* list)
+{
+	size_t n = strlen(name);
+
+	if (strncmp(arg, name, n) != 0 || arg[n] != '=')
+		return 0;
+
+	list->clear();
+	for (const char* p = arg + n + 1 ; *p != 0 ; )
+	{
+		char* end;
+		list->push_back(strtod(p, &end));
+		if (end == p)
+		{
+			fprintf(stderr, "Error: invalid list in %s.\n", arg);
+			exit(2);
+		}
+		p = (*end == ',') ? end + 1 : end;
+	}
+	return 1;
+}
+
+static double now_ms()
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec*1e3 + t.tv_nsec*1e-6;
+}
+
+// Positions of n points 5 cm apart along x around frac*L, stored as for
+// MATLAB ([x_1 .. x_n y_1 .. y_n z_1 .. z_n]).
+static std::vector<double> positions(int n, const double* L, double frac)
+{
+	std::vector<double> p(3*n);
+
+	for (int i = 0 ; i < n ; i++)
+	{
+		p[i] = frac*L[0] + 0.05*(i - 0.5*(n-1));
+		p[i + n] = frac*L[1];
+		p[i + 2*n] = frac*L[2];
+	}
+	return p;
+}
+
+int main(int argc, char* argv[])
+{
+	std::vector<double> scales(1, 0.5), t60s(1, 0.2), nsamples(1, 0), mics(1, 1), sources(1, 1);
+	std::vector<double> windows(1, 0.004), lp_filters(1, 0), threads(1, (double) sysconf(_SC_NPROCESSORS_ONLN));
+	double              fs = 16000;
+	int                 reps = 3;
+	int                 json = 0;
+	int                 first = 1;
+
+	scales.push_back(1); scales.push_back(2);
+	t60s.push_back(0.5);
+	mics.push_back(4);
+	windows.push_back(0.008);
+	lp_filters.push_back(1);
+
+	for (int a = 1 ; a < argc ; a++)
+	{
+		if (parse_list(argv[a], "--scales", &scales) || parse_list(argv[a], "--t60", &t60s) ||
+			parse_list(argv[a], "--nsample", &nsamples) || parse_list(argv[a], "--mics", &mics) ||
+			parse_list(argv[a], "--sources", &sources) || parse_list(argv[a], "--window_l", &windows) ||
+			parse_list(argv[a], "--lp_filter", &lp_filters) || parse_list(argv[a], "--threads", &threads))
+			continue;
+		if (strncmp(argv[a], "--fs=", 5) == 0)
+			fs = atof(argv[a] + 5);
+		else if (strncmp(argv[a], "--reps=", 7) == 0)
+			reps = atoi(argv[a] + 7);
+		else if (strcmp(argv[a], "--format=json") == 0)
+			json = 1;
+		else if (strcmp(argv[a], "--format=csv") != 0)
+		{
+			fprintf(stderr, "Error: unknown argument %s, see the header of rir_generator_bench.cpp.\n", argv[a]);
+			return 2;
+		}
+	}
+	if (reps < 1)
+		reps = 1;
+
+	if (json)
+		printf("[\n");
+	else
+		printf("mode,threads,Lx,Ly,Lz,volume,T60,beta,nsample,mics,sources,window_l,lp_filter,reps,"
+			"min_ms,median_ms,images_visited,images_accepted,ns_per_accepted,speedup\n");
+
+	for (size_t i_s = 0 ; i_s < scales.size() ; i_s++)
+	for (size_t i_t = 0 ; i_t < t60s.size() ; i_t++)
+	for (size_t i_n = 0 ; i_n < nsamples.size() ; i_n++)
+	for (size_t i_m = 0 ; i_m < mics.size() ; i_m++)
+	for (size_t i_l = 0 ; i_l < sources.size() ; i_l++)
+	for (size_t i_w = 0 ; i_w < windows.size() ; i_w++)
+	for (size_t i_p = 0 ; i_p < lp_filters.size() ; i_p++)
+	{
+		rir::Config cfg;
+		rir::Room   room;
+		int         nr_of_mics = (int) mics[i_m];
+		int         nr_of_louds = (int) sources[i_l];
+		double      serial_ms = 0;
+
+		// The window length only matters with the LPF
+		if (lp_filters[i_p] == 0 && i_w > 0)
+			continue;
+
+		for (int i = 0 ; i < 3 ; i++)
+			room.L[i] = scales[i_s]*((i == 0) ? 5 : (i == 1) ? 4 : 3);
+		try
+		{
+			double beta = rir::beta_from_t60(cfg.c, room.L, t60s[i_t]);
+			for (int i = 0 ; i < 6 ; i++)
+				room.beta[i] = beta;
+		}
+		catch (const rir::Error&)
+		{
+			fprintf(stderr, "Skipping L = %g x %g x %g with T60 = %g: no reflection coefficients.\n",
+				room.L[0], room.L[1], room.L[2], t60s[i_t]);
+			continue;
+		}
+
+		std::vector<double> rr = positions(nr_of_mics, room.L, 0.3);
+		std::vector<double> ss = positions(nr_of_louds, room.L, 0.7);
+		room.r = &rr[0];
+		room.s = &ss[0];
+
+		cfg.fs = fs;
+		cfg.nsamples = (nsamples[i_n] > 0) ? (unsigned int) nsamples[i_n] : (unsigned int) (t60s[i_t]*fs);
+		cfg.window_l = windows[i_w];
+		cfg.lp_filter = (int) lp_filters[i_p];
+
+		std::vector<double> h((uint64_t)cfg.nsamples*nr_of_mics*nr_of_louds);
+
+		// Serial mode first, then the threaded mode for every thread count
+		for (int mode = 0 ; mode <= (int) threads.size() ; mode++)
+		{
+			cfg.num_threads = (mode == 0) ? 1 : (int) threads[mode-1];
+			cfg.parallel = (mode == 0) ? rir::PARALLEL_MIC : rir::PARALLEL_AUTO;
+
+			rir::Generator      gen(cfg);
+			std::vector<double> ms(reps);
+
+			for (int r = 0 ; r < reps ; r++)
+			{
+				std::fill(h.begin(), h.end(), 0.);
+				double t0 = now_ms();
+				gen.compute(&room, 1, nr_of_mics, nr_of_louds, &h[0]);
+				ms[r] = now_ms() - t0;
+			}
+			std::sort(ms.begin(), ms.end());
+
+			double   median = (reps % 2) ? ms[reps/2] : 0.5*(ms[reps/2-1] + ms[reps/2]);
+			uint64_t accepted = gen.counters().images_accepted;
+			double   ns_per = (accepted > 0) ? median*1e6/accepted : 0;
+			if (mode == 0)
+				serial_ms = median;
+
+			const char* name = (mode == 0) ? "serial" : "threaded";
+			if (json)
+			{
+				printf("%s  {\"mode\": \"%s\", \"threads\": %d, \"L\": [%g, %g, %g], \"volume\": %g, "
+					"\"T60\": %g, \"beta\": %.6f, \"nsample\": %u, \"mics\": %d, \"sources\": %d, "
+					"\"window_l\": %g, \"lp_filter\": %d, \"reps\": %d, \"min_ms\": %.3f, "
+					"\"median_ms\": %.3f, \"images_visited\": %llu, \"images_accepted\": %llu, "
+					"\"ns_per_accepted\": %.2f, \"speedup\": %.3f}",
+					first ? "" : ",\n", name, cfg.num_threads, room.L[0], room.L[1], room.L[2],
+					room.L[0]*room.L[1]*room.L[2], t60s[i_t], room.beta[0], cfg.nsamples,
+					nr_of_mics, nr_of_louds, cfg.window_l, cfg.lp_filter, reps, ms[0], median,
+					(unsigned long long) gen.counters().images_visited, (unsigned long long) accepted,
+					ns_per, serial_ms/median);
+			}
+			else
+			{
+				printf("%s,%d,%g,%g,%g,%g,%g,%.6f,%u,%d,%d,%g,%d,%d,%.3f,%.3f,%llu,%llu,%.2f,%.3f\n",
+					name, cfg.num_threads, room.L[0], room.L[1], room.L[2],
+					room.L[0]*room.L[1]*room.L[2], t60s[i_t], room.beta[0], cfg.nsamples,
+					nr_of_mics, nr_of_louds, cfg.window_l, cfg.lp_filter, reps, ms[0], median,
+					(unsigned long long) gen.counters().images_visited, (unsigned long long) accepted,
+					ns_per, serial_ms/median);
+			}
+			first = 0;
+			fflush(stdout);
+		}
+	}
+
+	if (json)
+		printf("\n]\n");
+	rir::shutdown_threads();
+	return 0;
+}
@@ -0,0 +1,446 @@
+/*
+Program     : Room Impulse Response Generator - command line tool
+
+Description : Computes the room impulse responses of one room with
+              rir::Generator, without MATLAB, and writes them to a WAV file
+              (32-bit float, one channel per receiver and source), to a raw
+              file of little-endian 32-bit floats stored as the MEX output,
+              nsample x M x N, or to a response file (.rir, rir_file.h) that
+              the threads write through a memory mapping, for responses that
+              do not fit in the memory. Every output holds 32-bit floats
+              unless precision is given: the WAV and raw files are computed in
+              double precision and converted, the response file is computed
+              in single precision, or in double and stored as such with
+              precision = double.
+
+              Build:
+                g++ -O2 -pthread rir_generator_cli.cpp rir_generator.cpp -o rir_generator_cli
+
+              Usage:
+                rir_generator_cli [-v] room.ini out.wav|out.raw|out.rir
+
+              The room is given as key = value lines, with the arguments of
+              the MEX files and the fields of their options structure. One
+              receiver or source per line, lines starting with # are
+              comments:
+
+                c = 343
+                fs = 16000
+                L = 5 4 6
+                beta = 0.4              (T60 in s, or the 6 coefficients)
+                band = 0.9 0.9 0.9 0.9 0.9 0.9   (octave bands instead of beta,
+                band = 0.8 0.8 0.8 0.8 0.8 0.8    one line per band)
+                band_fc = 125           (centre of the first band in Hz)
+                nsample = 4096          (default T60*fs)
+                mtype = omnidirectional
+                order = -1
+                dim = 1 1 1
+                orientation = 0         (angle in rad, or yaw pitch roll, or a
+                                         quaternion w x y z, for all receivers)
+                hp_filter = 1
+                lp_filter = 1
+                window_l = 0.008
+                receiver = 2 1.5 2
+                receiver = 2.1 1.5 2
+                source = 2 3.5 2
+                enumeration = sphere
+                gain_tables = 1
+                lpf_oversampling = 0
+                transition = 0
+                simd = auto
+                parallel = auto
+                num_threads = 0
+                deterministic = 0       (1: same result for every num_threads)
+                affinity = none         (compact or scatter pins the threads)
+                precision = double      (single or double, default float32 output)
+
+              -v prints the table sizes, the placement of the threads and the
+              time of the computation.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <vector>
+#include <algorithm>
+#include <memory>
+#include "rir_generator.h"
+
+struct spec_s
+{
+	rir::Config         cfg;
+	rir::Room           room;
+	int                 nr_of_beta;
+	std::vector<double> bands;      // 6 coefficients per octave band
+	double              orientation[4]; // [yaw pitch roll] or [w x y z]
+	std::vector<double> r[3];
+	std::vector<double> s[3];
+	int                 single;     // -1 = not given
+};
+
+// Reads up to n numbers from str into v; returns how many were read.
+static int read_numbers(const char* str, double* v, int n)
+{
+	int   i = 0;
+	char* end;
+
+	while (i < n)
+	{
+		v[i] = strtod(str, &end);
+		if (end == str)
+			break;
+		str = end;
+		i++;
+	}
+	while (*str == ' ' || *str == '\t')
+		str++;
+	return (*str == 0) ? i : -1;
+}
+
+static int read_spec(const char* file, struct spec_s* spec)
+{
+	FILE*  f = fopen(file, "r");
+	char   line[1024];
+	int    nr = 0;
+
+	if (f == NULL)
+	{
+		fprintf(stderr, "Error: cannot open %s.\n", file);
+		return 0;
+	}
+
+	spec->nr_of_beta = 0;
+	spec->single = -1;
+	spec->room.L[0] = spec->room.L[1] = spec->room.L[2] = 0;
+
+	while (fgets(line, sizeof(line), f) != NULL)
+	{
+		char*  key = line;
+		char*  value;
+		char*  end;
+		double v[6];
+		int    n;
+
+		nr++;
+		line[strcspn(line, "\r\n")] = 0;
+		while (*key == ' ' || *key == '\t')
+			key++;
+		if (*key == 0 || *key == '#')
+			continue;
+
+		value = strchr(key, '=');
+		if (value == NULL)
+		{
+			fprintf(stderr, "Error: %s:%d: expected key = value.\n", file, nr);
+			fclose(f);
+			return 0;
+		}
+		for (end = value; end > key && (end[-1] == ' ' || end[-1] == '\t'); end--)
+			;
+		*end = 0;
+		value++;
+		while (*value == ' ' || *value == '\t')
+			value++;
+		for (end = value + strlen(value); end > value && (end[-1] == ' ' || end[-1] == '\t'); end--)
+			;
+		*end = 0;
+
+		n = read_numbers(value, v, 6);
+		if (strcmp(key, "c") == 0 && n == 1)
+			spec->cfg.c = v[0];
+		else if (strcmp(key, "fs") == 0 && n == 1)
+			spec->cfg.fs = v[0];
+		else if (strcmp(key, "L") == 0 && n == 3)
+			memcpy(spec->room.L, v, 3*sizeof(double));
+		else if (strcmp(key, "beta") == 0 && (n == 1 || n == 6))
+		{
+			memcpy(spec->room.beta, v, n*sizeof(double));
+			spec->nr_of_beta = n;
+		}
+		else if (strcmp(key, "band") == 0 && n == 6)
+			spec->bands.insert(spec->bands.end(), v, v + 6);
+		else if (strcmp(key, "band_fc") == 0 && n == 1 && v[0] > 0)
+			spec->cfg.band_fc = v[0];
+		else if (strcmp(key, "nsample") == 0 && n == 1 && v[0] >= 0)
+			spec->cfg.nsamples = (unsigned int) v[0];
+		else if (strcmp(key, "mtype") == 0 && *value != 0)
+			spec->cfg.mtype = value[0];
+		else if (strcmp(key, "order") == 0 && n == 1)
+			spec->cfg.order = (int) v[0];
+		else if (strcmp(key, "dim") == 0 && n == 3)
+			for (int i = 0 ; i < 3 ; i++)
+				spec->cfg.dim[i] = (v[i] == 0) ? 0 : 1;
+		else if (strcmp(key, "orientation") == 0 && n == 1)
+			spec->cfg.angle = v[0];
+		else if (strcmp(key, "orientation") == 0 && (n == 3 || n == 4))
+		{
+			memcpy(spec->orientation, v, n*sizeof(double));
+			spec->cfg.orientation = spec->orientation;
+			spec->cfg.orientation_rows = 1;
+			spec->cfg.orientation_cols = n;
+		}
+		else if (strcmp(key, "hp_filter") == 0 && n == 1)
+			spec->cfg.hp_filter = (int) v[0];
+		else if (strcmp(key, "lp_filter") == 0 && n == 1)
+			spec->cfg.lp_filter = (int) v[0];
+		else if (strcmp(key, "window_l") == 0 && n == 1)
+			spec->cfg.window_l = v[0];
+		else if (strcmp(key, "receiver") == 0 && n == 3)
+			for (int i = 0 ; i < 3 ; i++)
+				spec->r[i].push_back(v[i]);
+		else if (strcmp(key, "source") == 0 && n == 3)
+			for (int i = 0 ; i < 3 ; i++)
+				spec->s[i].push_back(v[i]);
+		else if (strcmp(key, "enumeration") == 0 && rir::parse_enumeration(value, &spec->cfg.enumeration))
+			;
+		else if (strcmp(key, "gain_tables") == 0 && n == 1)
+			spec->cfg.gain_tables = (int) v[0];
+		else if (strcmp(key, "lpf_oversampling") == 0 && n == 1)
+			spec->cfg.lpf_oversampling = (int) v[0];
+		else if (strcmp(key, "transition") == 0 && n == 1 && v[0] >= 0)
+			spec->cfg.transition = v[0];
+		else if (strcmp(key, "simd") == 0 && rir::parse_simd(value, &spec->cfg.simd))
+			;
+		else if (strcmp(key, "parallel") == 0 && rir::parse_parallel(value, &spec->cfg.parallel))
+			;
+		else if (strcmp(key, "num_threads") == 0 && n == 1 && v[0] >= 0)
+			spec->cfg.num_threads = (int) v[0];
+		else if (strcmp(key, "deterministic") == 0 && n == 1)
+			spec->cfg.deterministic = (int) v[0];
+		else if (strcmp(key, "affinity") == 0 && rir::parse_affinity(value, &spec->cfg.affinity))
+			;
+		else if (strcmp(key, "precision") == 0 && (strcmp(value, "double") == 0 || strcmp(value, "single") == 0))
+			spec->single = (strcmp(value, "single") == 0);
+		else
+		{
+			fprintf(stderr, "Error: %s:%d: invalid value for '%s'.\n", file, nr, key);
+			fclose(f);
+			return 0;
+		}
+	}
+	fclose(f);
+
+	if (spec->room.L[0] <= 0 || (spec->nr_of_beta == 0 && spec->bands.empty()) || spec->r[0].empty() || spec->s[0].empty())
+	{
+		fprintf(stderr, "Error: %s must give L, beta or bands and at least one receiver and source.\n", file);
+		return 0;
+	}
+	return 1;
+}
+
+static void put_u32(unsigned char* p, uint32_t v)
+{
+	p[0] = v & 0xff; p[1] = (v >> 8) & 0xff; p[2] = (v >> 16) & 0xff; p[3] = (v >> 24) & 0xff;
+}
+
+static void put_u16(unsigned char* p, uint16_t v)
+{
+	p[0] = v & 0xff; p[1] = (v >> 8) & 0xff;
+}
+
+// Writes the nsamples x nr_of_channels responses h as little-endian floats:
+// channel after channel for raw files, interleaved for WAV files.
+static int write_output(const char* file, const float* h, unsigned int nsamples,
+	unsigned int nr_of_channels, double fs)
+{
+	const char*    ext = strrchr(file, '.');
+	int            wav = (ext != NULL && strcmp(ext, ".wav") == 0);
+	FILE*          f = fopen(file, "wb");
+	unsigned char  buf[44];
+	uint64_t       total = (uint64_t)nsamples*nr_of_channels;
+	int            ok = 1;
+
+	if (f == NULL)
+	{
+		fprintf(stderr, "Error: cannot create %s.\n", file);
+		return 0;
+	}
+
+	if (wav)
+	{
+		if (4*total > 0xffffffffu - 36)
+		{
+			fprintf(stderr, "Error: the responses do not fit in a WAV file, use a raw file.\n");
+			fclose(f);
+			return 0;
+		}
+		memcpy(buf, "RIFF", 4);
+		put_u32(buf+4, (uint32_t)(36 + 4*total));
+		memcpy(buf+8, "WAVEfmt ", 8);
+		put_u32(buf+16, 16);
+		put_u16(buf+20, 3);                         // IEEE float
+		put_u16(buf+22, (uint16_t) nr_of_channels);
+		put_u32(buf+24, (uint32_t) fs);
+		put_u32(buf+28, (uint32_t) fs*4*nr_of_channels);
+		put_u16(buf+32, (uint16_t)(4*nr_of_channels));
+		put_u16(buf+34, 32);
+		memcpy(buf+36, "data", 4);
+		put_u32(buf+40, (uint32_t)(4*total));
+		ok = (fwrite(buf, 1, 44, f) == 44);
+	}
+
+	for (uint64_t i = 0 ; ok && i < total ; i++)
+	{
+		uint64_t idx = wav ? (i % nr_of_channels)*nsamples + i/nr_of_channels : i;
+		uint32_t u;
+
+		memcpy(&u, &h[idx], 4);
+		put_u32(buf, u);
+		ok = (fwrite(buf, 1, 4, f) == 4);
+	}
+
+	if (fclose(f) != 0 || !ok)
+	{
+		fprintf(stderr, "Error: writing %s failed.\n", file);
+		return 0;
+	}
+	return 1;
+}
+
+int main(int argc, char* argv[])
+{
+	struct spec_s spec;
+	int           verbose = 0;
+	int           arg = 1;
+
+	if (argc > 1 && strcmp(argv[1], "-v") == 0)
+	{
+		verbose = 1;
+		arg++;
+	}
+	if (argc - arg != 2)
+	{
+		fprintf(stderr, "Usage: %s [-v] room.ini out.wav|out.raw|out.rir\n", argv[0]);
+		return 2;
+	}
+	if (!read_spec(argv[arg], &spec))
+		return 1;
+
+	const char*  ext = strrchr(argv[arg+1], '.');
+	int          mapped = (ext != NULL && strcmp(ext, ".rir") == 0);
+
+	// Without precision the response file holds 32-bit floats like the others
+	if (spec.single < 0)
+		spec.single = mapped;
+	unsigned int nr_of_mics = (unsigned int) spec.r[0].size();
+	unsigned int nr_of_louds = (unsigned int) spec.s[0].size();
+	std::vector<double> rr, ss;
+	std::unique_ptr<float[]> h;
+
+	for (int i = 0 ; i < 3 ; i++)
+	{
+		rr.insert(rr.end(), spec.r[i].begin(), spec.r[i].end());
+		ss.insert(ss.end(), spec.s[i].begin(), spec.s[i].end());
+	}
+	spec.room.r = &rr[0];
+	spec.room.s = &ss[0];
+
+	try
+	{
+		// Reflection coefficients per octave band, reflection coefficients or
+		// Reverberation Time?
+		if (!spec.bands.empty())
+		{
+			spec.cfg.nr_of_bands = (int) spec.bands.size()/6;
+			spec.room.band_beta = &spec.bands[0];
+
+			// The default length follows from the band with the longest T60
+			double TR = 0;
+			for (int b = 0 ; b < spec.cfg.nr_of_bands ; b++)
+				TR = std::max(TR, rir::t60_from_beta(spec.cfg.c, spec.room.L, &spec.bands[6*b], spec.cfg.dim));
+			if (spec.cfg.nsamples == 0)
+				spec.cfg.nsamples = (unsigned int) (TR*spec.cfg.fs);
+		}
+		else if (spec.nr_of_beta == 1)
+		{
+			double T60 = spec.room.beta[0];
+			double beta = rir::beta_from_t60(spec.cfg.c, spec.room.L, T60);
+			for (int i = 0 ; i < 6 ; i++)
+				spec.room.beta[i] = beta;
+			if (spec.cfg.nsamples == 0)
+				spec.cfg.nsamples = (unsigned int) (T60*spec.cfg.fs);
+		}
+		else if (spec.cfg.nsamples == 0)
+			spec.cfg.nsamples = (unsigned int) (rir::t60_from_beta(spec.cfg.c, spec.room.L, spec.room.beta, spec.cfg.dim)*spec.cfg.fs);
+
+		// With pinned threads the responses are not zeroed here but by the
+		// threads that compute them, so that their pages lie on those nodes
+		spec.cfg.first_touch = (spec.cfg.affinity != rir::AFFINITY_NONE && !mapped);
+
+		rir::Generator gen(spec.cfg);
+		uint64_t       total = (uint64_t)spec.cfg.nsamples*nr_of_mics*nr_of_louds;
+		clock_t        t0 = clock();
+		struct timespec w0, w1;
+
+		clock_gettime(CLOCK_MONOTONIC, &w0);
+		if (mapped)
+			gen.compute_file(&spec.room, 1, nr_of_mics, nr_of_louds, argv[arg+1], spec.single != 0);
+		else if (spec.single)
+		{
+			h.reset(new float[total]);
+			if (!spec.cfg.first_touch)
+				std::fill(&h[0], &h[0] + total, 0.f);
+			gen.compute(&spec.room, 1, nr_of_mics, nr_of_louds, &h[0]);
+		}
+		else
+		{
+			std::unique_ptr<double[]> hd(new double[total]);
+			if (!spec.cfg.first_touch)
+				std::fill(&hd[0], &hd[0] + total, 0.);
+			h.reset(new float[total]);
+			gen.compute(&spec.room, 1, nr_of_mics, nr_of_louds, &hd[0]);
+			for (uint64_t i = 0 ; i < total ; i++)
+				h[i] = (float) hd[i];
+		}
+		clock_gettime(CLOCK_MONOTONIC, &w1);
+
+		if (fabs(gen.tail_mismatch()) > 3)
+			fprintf(stderr, "Warning: the energy before the transition deviates %.1f dB from the decay of the"
+				" late reverberation; a later transition fits better.\n", gen.tail_mismatch());
+
+		if (verbose)
+		{
+			const rir::TableBytes& bytes = gen.table_bytes();
+			if (spec.cfg.nr_of_bands > 0)
+				fprintf(stderr, "%u receiver(s) x %u source(s) x %u samples, %d octave bands from %g Hz\n",
+					nr_of_mics, nr_of_louds, spec.cfg.nsamples, spec.cfg.nr_of_bands, spec.cfg.band_fc);
+			else
+				fprintf(stderr, "%u receiver(s) x %u source(s) x %u samples, beta = %g\n",
+					nr_of_mics, nr_of_louds, spec.cfg.nsamples, spec.room.beta[0]);
+			fprintf(stderr, "  image lattice tables: %zu bytes\n", bytes.lattice);
+			fprintf(stderr, "  reflection gain tables: %zu bytes\n", bytes.gains);
+			fprintf(stderr, "  LPF kernel table: %zu bytes\n", bytes.lpf);
+			if (spec.cfg.nr_of_bands > 0)
+				fprintf(stderr, "  octave-band filterbank: %zu bytes\n", bytes.filterbank);
+			if (spec.cfg.transition > 0)
+				fprintf(stderr, "  late reverberation envelopes: %zu bytes, mismatch %.2f dB\n", bytes.tail, gen.tail_mismatch());
+			if (spec.cfg.affinity != rir::AFFINITY_NONE)
+			{
+				const std::vector<rir::Placement>& place = gen.placement();
+				for (size_t t = 0 ; t < place.size() ; t++)
+				{
+					if (place[t].cpu < 0)
+						fprintf(stderr, "  thread %zu: not pinned\n", t);
+					else
+						fprintf(stderr, "  thread %zu: cpu %d, node %d\n", t, place[t].cpu, place[t].node);
+				}
+			}
+			fprintf(stderr, "  %.1f ms (%.1f ms cpu)\n",
+				(w1.tv_sec - w0.tv_sec)*1e3 + (w1.tv_nsec - w0.tv_nsec)*1e-6,
+				(clock() - t0)*1e3/CLOCKS_PER_SEC);
+		}
+	}
+	catch (const rir::Error& e)
+	{
+		fprintf(stderr, "%s\n", e.what());
+		return 1;
+	}
+
+	rir::shutdown_threads();
+	if (mapped)
+		return 0;
+	return write_output(argv[arg+1], &h[0], spec.cfg.nsamples, nr_of_mics*nr_of_louds, spec.cfg.fs) ? 0 : 1;
+}
@@ -0,0 +1,1012 @@
+/*
+Program     : Room Impulse Response Generator - MATLAB interface
+
+Description : Translates the arguments of rir_generator_x.cpp and
+              rir_generator_x_threaded.cpp into a rir::Config and rir::Room's,
+              runs rir::Generator and returns the responses or image lists as
+              MATLAB arrays, or with options.signals the signals of the
+              receivers (rir::Convolver). The help text of both MEX files
+              describes the arguments. rir_generator_session.cpp keeps a
+              rir::Session per room between calls, and rir_hp_filter.cpp
+              applies the high-pass filter (rir::hp_filter) to responses.
+*/
+
+#ifndef RIR_GENERATOR_MEX_H
+#define RIR_GENERATOR_MEX_H
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "matrix.h"
+#include "mex.h"
+#include "math.h"
+#include "string.h"
+#include "rir_generator.h"
+#include "rir_image_list.h"
+
+// Ctrl-C in the command window; not in the documented API, the MEX files are
+// linked with -lut for it.
+extern "C" bool utIsInterruptPending(void);
+
+static const char* rir_image_fields[4] = { "delay", "gain", "order", "hits" };
+
+// Stores the images, earliest first, in element idx of the structure array
+// out: delay and gain as K x 1, the reflection order as K x 1 and the wall
+// hits as K x 6.
+static void rir_image_list_store(const struct rir_image_list* list, mxArray* out, mwIndex idx)
+{
+	int      K = list->nr_of_images;
+	mxArray* delay = mxCreateDoubleMatrix(K, 1, mxREAL);
+	mxArray* gain = mxCreateDoubleMatrix(K, 1, mxREAL);
+	mxArray* order = mxCreateDoubleMatrix(K, 1, mxREAL);
+	mxArray* hits = mxCreateDoubleMatrix(K, 6, mxREAL);
+
+	qsort(list->images, K, sizeof(struct rir_image), rir_image_cmp);
+	for (int i = 0 ; i < K ; i++)
+	{
+		const struct rir_image* img = &list->images[i];
+		mxGetPr(delay)[i] = img->delay;
+		mxGetPr(gain)[i] = img->gain;
+		mxGetPr(order)[i] = 0;
+		for (int w = 0 ; w < 6 ; w++)
+		{
+			mxGetPr(hits)[i + w*K] = img->hits[w];
+			mxGetPr(order)[i] += img->hits[w];
+		}
+	}
+
+	mxSetField(out, idx, "delay", delay);
+	mxSetField(out, idx, "gain", gain);
+	mxSetField(out, idx, "order", order);
+	mxSetField(out, idx, "hits", hits);
+}
+
+static const char* rir_counter_fields[14] = { "tasks", "images_visited", "images_rejected_order",
+	"images_rejected_distance", "images_accepted", "taps_written", "cycles_total", "cycles_images",
+	"cycles_lpf", "cycles_scatter", "cycles_hp_filter", "cycles_reduce", "cycles_filterbank", "timer" };
+
+static uint64_t rir::Counters::* const rir_counter_members[13] = { &rir::Counters::tasks,
+	&rir::Counters::images_visited, &rir::Counters::images_rejected_order,
+	&rir::Counters::images_rejected_distance, &rir::Counters::images_accepted,
+	&rir::Counters::taps_written, &rir::Counters::cycles_total, &rir::Counters::cycles_images,
+	&rir::Counters::cycles_lpf, &rir::Counters::cycles_scatter, &rir::Counters::cycles_hp_filter,
+	&rir::Counters::cycles_reduce, &rir::Counters::cycles_filterbank };
+
+// Returns the counters of the last call of gen as a 1 x 1 structure with
+// every counter as a T x 1 vector, one entry per thread, and the unit of the
+// cycle counters in 'timer'.
+static mxArray* rir_counters_create(const rir::Generator& gen)
+{
+	const std::vector<rir::Counters>& threads = gen.thread_counters();
+	mxArray* out = mxCreateStructMatrix(1, 1, 14, rir_counter_fields);
+
+	for (int f = 0 ; f < 13 ; f++)
+	{
+		mxArray* v = mxCreateDoubleMatrix(threads.size(), 1, mxREAL);
+		for (size_t t = 0 ; t < threads.size() ; t++)
+			mxGetPr(v)[t] = (double) (threads[t].*rir_counter_members[f]);
+		mxSetField(out, 0, rir_counter_fields[f], v);
+	}
+	mxSetField(out, 0, "timer", mxCreateString(rir::counter_timer()));
+	return out;
+}
+
+// Returns the field 'name' of the options structure, or NULL when either the
+// structure or the field is absent.
+static const mxArray* get_option(const mxArray* options, const char* name)
+{
+	if (options == NULL)
+		return NULL;
+	return mxGetField(options, 0, name);
+}
+
+// Reads the option 'name' as a string of at most len-1 characters into buf.
+// Returns 0 when the option is absent.
+static int get_option_string(const mxArray* options, const char* name, char* buf, int len)
+{
+	const mxArray* opt = get_option(options, name);
+
+	if (opt == NULL)
+		return 0;
+	if (!mxIsChar(opt) || mxGetString(opt, buf, len) != 0)
+		mexErrMsgTxt("Invalid input arguments!");
+	return 1;
+}
+
+// The arguments (c, fs, r, s, L, beta, nsample, mtype, order, dim, orientation,
+// hp_filter, lp_filter, window_l, options) of a call as engine settings and
+// rooms. The rooms and the types of the receivers are allocated with
+// mxCalloc, for the duration of the call.
+struct rir_mex_args
+{
+	rir::Config     cfg;
+	rir::Room*      rooms;
+	unsigned int    nr_of_rooms;
+	unsigned int    nr_of_mics;
+	unsigned int    nr_of_louds;
+	unsigned int    nr_of_bands;
+	int             single;
+	int             image_list;
+	int             verbose;
+	const double*   signals;
+	uint64_t        signal_length;
+	unsigned int    signal_block;
+	const mxArray*  progress_fn;
+	int             progress_print;
+	const char*     file;
+};
+
+// Parses the arguments prhs into args; beta_hat is set to the K x 1 reflection
+// coefficients that follow from a reverberation time. With threaded == 0 the
+// RIRs are computed in the calling thread, one room per call, and the options
+// for the threads are ignored.
+static void rir_mex_parse(int threaded, int nrhs, const mxArray *prhs[], mxArray** beta_hat_out,
+	struct rir_mex_args* args)
+{
+	// Check for proper number of arguments
+	if (nrhs < 6)
+		mexErrMsgTxt("Error: There are at least six input parameters required.");
+	if (nrhs > 15)
+		mexErrMsgTxt("Error: Too many input arguments.");
+
+	// Check for proper arguments
+	if (!(mxGetN(prhs[0])==1) || !mxIsDouble(prhs[0]) || mxIsComplex(prhs[0]))
+		mexErrMsgTxt("Invalid input arguments!");
+	if (!(mxGetN(prhs[1])==1) || !mxIsDouble(prhs[1]) || mxIsComplex(prhs[1]))
+		mexErrMsgTxt("Invalid input arguments!");
+	if (mxGetNumberOfDimensions(prhs[2]) > 3 || !(mxGetDimensions(prhs[2])[1]==3) || !mxIsDouble(prhs[2]) || mxIsComplex(prhs[2]))
+		mexErrMsgTxt("Invalid input arguments!");
+	if (mxGetNumberOfDimensions(prhs[3]) > 3 || !(mxGetDimensions(prhs[3])[1]==3) || !mxIsDouble(prhs[3]) || mxIsComplex(prhs[3]))
+		mexErrMsgTxt("Invalid input arguments!");
+	if (!(mxGetN(prhs[4])==3) || !mxIsDouble(prhs[4]) || mxIsComplex(prhs[4]))
+		mexErrMsgTxt("Invalid input arguments!");
+	if (!(mxGetN(prhs[5])==6 || mxGetN(prhs[5])==1 || mxGetM(prhs[5])==6) || !mxIsDouble(prhs[5]) || mxIsComplex(prhs[5]))
+		mexErrMsgTxt("Invalid input arguments!");
+
+	// Engine options (optional)
+	const mxArray*  options = NULL;
+	if (nrhs > 14 && mxIsEmpty(prhs[14]) == false)
+	{
+		if (!mxIsStruct(prhs[14]))
+			mexErrMsgTxt("Invalid input arguments!");
+		options = prhs[14];
+	}
+
+	// Octave-band reflection coefficients: beta as 6 x B, or 6 x B x K for a
+	// batch. A 6 x 6 beta could also be a batch of 6 rooms (K x 6), so it
+	// only holds bands when options.band_fc is given; without it, it is a
+	// batch in the threaded version and an error in the other one.
+	const mwSize*   beta_dims = mxGetDimensions(prhs[5]);
+	unsigned int    nr_of_bands = 0;
+	int             beta_6x6 = (mxGetNumberOfDimensions(prhs[5]) == 2 && beta_dims[0] == 6 && beta_dims[1] == 6);
+	if (mxGetM(prhs[5]) == 6 && mxGetN(prhs[5]) > 1 && (!beta_6x6 || get_option(options, "band_fc") != NULL))
+		nr_of_bands = (unsigned int) beta_dims[1];
+	else if (beta_6x6 && !threaded)
+		mexErrMsgTxt("Error: A 6 x 6 beta holds 6 octave bands only when options.band_fc is given.");
+	else if (mxGetNumberOfDimensions(prhs[5]) > 2 || !(mxGetN(prhs[5])==6 || mxGetN(prhs[5])==1))
+		mexErrMsgTxt("Invalid input arguments!");
+
+	// Number of rooms given by each of r, s, L and beta: 1 when the input is
+	// shared by all rooms of a batch.
+	unsigned int    rooms_in[4];
+	unsigned int    nr_of_rooms = 1;
+
+	rooms_in[0] = (mxGetNumberOfDimensions(prhs[2]) > 2) ? (unsigned int) mxGetDimensions(prhs[2])[2] : 1;
+	rooms_in[1] = (mxGetNumberOfDimensions(prhs[3]) > 2) ? (unsigned int) mxGetDimensions(prhs[3])[2] : 1;
+	rooms_in[2] = (unsigned int) mxGetM(prhs[4]);
+	if (nr_of_bands > 0)
+		rooms_in[3] = (mxGetNumberOfDimensions(prhs[5]) > 2) ? (unsigned int) beta_dims[2] : 1;
+	else
+		rooms_in[3] = (unsigned int) mxGetM(prhs[5]);
+	for (int i = 0 ; i < 4 ; i++)
+		if (rooms_in[i] > nr_of_rooms)
+			nr_of_rooms = rooms_in[i];
+	if (!threaded && nr_of_rooms > 1)
+		mexErrMsgTxt("Invalid input arguments!");
+	for (int i = 0 ; i < 4 ; i++)
+		if (rooms_in[i] != 1 && rooms_in[i] != nr_of_rooms)
+			mexErrMsgTxt("Error: r, s, L and beta must give the same number of rooms K, or be the same for all rooms.");
+
+	// Load parameters
+	const double*   rr = mxGetPr(prhs[2]);
+	unsigned int    nr_of_mics = (unsigned int) mxGetM(prhs[2]);
+	const double*   ss = mxGetPr(prhs[3]);
+	unsigned int    nr_of_louds = (unsigned int) mxGetM(prhs[3]);
+	const double*   LL = mxGetPr(prhs[4]);
+	const double*   beta_ptr = mxGetPr(prhs[5]);
+	rir::Config     cfg;
+	rir::Room*      rooms = (rir::Room*) mxCalloc(nr_of_rooms, sizeof(rir::Room));
+	int             single;
+	int             image_list;
+	int             verbose;
+	const mxArray*  opt;
+	char            buf[8];
+	char            msg[512];
+
+	cfg.c = mxGetScalar(prhs[0]);
+	cfg.fs = mxGetScalar(prhs[1]);
+
+	*beta_hat_out = mxCreateDoubleMatrix(nr_of_rooms, 1, mxREAL);
+	double* beta_hat = mxGetPr(*beta_hat_out);
+
+	msg[0] = 0;
+	try
+	{
+		for (unsigned int k = 0 ; k < nr_of_rooms ; k++)
+		{
+			rir::Room*   room = &rooms[k];
+			unsigned int kb = (rooms_in[3] > 1) ? k : 0;
+
+			for (int i = 0 ; i < 3 ; i++)
+				room->L[i] = LL[((rooms_in[2] > 1) ? k : 0) + i*rooms_in[2]];
+			room->r = rr + ((rooms_in[0] > 1) ? (uint64_t)k*3*nr_of_mics : 0);
+			room->s = ss + ((rooms_in[1] > 1) ? (uint64_t)k*3*nr_of_louds : 0);
+			beta_hat[k] = 0;
+
+			// Reflection coefficients per octave band, reflection coefficients or
+			// Reverberation Time?
+			if (nr_of_bands > 0)
+			{
+				room->band_beta = beta_ptr + (uint64_t)kb*6*nr_of_bands;
+			}
+			else if (mxGetN(prhs[5])==1)
+			{
+				beta_hat[k] = rir::beta_from_t60(cfg.c, room->L, beta_ptr[kb]);
+				for (int i=0;i<6;i++)
+					room->beta[i] = beta_hat[k];
+			}
+			else
+			{
+				for (int i=0;i<6;i++)
+					room->beta[i] = beta_ptr[kb + i*rooms_in[3]];
+			}
+		}
+	}
+	catch (const rir::Error& e)
+	{
+		strncpy(msg, e.what(), sizeof(msg)-1);
+		msg[sizeof(msg)-1] = 0;
+	}
+	if (msg[0] != 0)
+		mexErrMsgTxt(msg);
+
+	// Image enumeration (optional)
+	if (get_option_string(options, "enumeration", buf, sizeof(buf)) && !rir::parse_enumeration(buf, &cfg.enumeration))
+		mexErrMsgTxt("Error: options.enumeration must be 'sphere' or 'box'.");
+
+	// Reflection gain tables (optional)
+	if ((opt = get_option(options, "gain_tables")) != NULL)
+	{
+		if (mxIsEmpty(opt) || !(mxIsLogical(opt) || mxIsDouble(opt)))
+			mexErrMsgTxt("Invalid input arguments!");
+		cfg.gain_tables = (int) mxGetScalar(opt);
+	}
+
+	// Oversampling of the LPF kernel table (optional)
+	if ((opt = get_option(options, "lpf_oversampling")) != NULL)
+	{
+		if (mxIsEmpty(opt) || !mxIsDouble(opt) || mxGetScalar(opt) < 0)
+			mexErrMsgTxt("Invalid input arguments!");
+		cfg.lpf_oversampling = (int) mxGetScalar(opt);
+	}
+
+	// Vectorized image kernels (optional)
+	if (get_option_string(options, "simd", buf, sizeof(buf)) && !rir::parse_simd(buf, &cfg.simd))
+		mexErrMsgTxt("Error: options.simd must be 'auto', 'avx512', 'avx2', 'sse2', 'scalar' or 'off'.");
+
+	// Parallel decomposition and number of threads (optional)
+	if (threaded)
+	{
+		if (get_option_string(options, "parallel", buf, sizeof(buf)) && !rir::parse_parallel(buf, &cfg.parallel))
+			mexErrMsgTxt("Error: options.parallel must be 'auto', 'mic' or 'image'.");
+
+		if ((opt = get_option(options, "num_threads")) != NULL)
+		{
+			if (mxIsEmpty(opt) || !mxIsDouble(opt) || mxGetScalar(opt) < 1)
+				mexErrMsgTxt("Invalid input arguments!");
+			cfg.num_threads = (int) mxGetScalar(opt);
+		}
+
+		if ((opt = get_option(options, "deterministic")) != NULL)
+		{
+			if (mxIsEmpty(opt) || !(mxIsLogical(opt) || mxIsDouble(opt)))
+				mexErrMsgTxt("Invalid input arguments!");
+			cfg.deterministic = (int) mxGetScalar(opt);
+		}
+
+		if (get_option_string(options, "affinity", buf, sizeof(buf)) && !rir::parse_affinity(buf, &cfg.affinity))
+			mexErrMsgTxt("Error: options.affinity must be 'none', 'compact' or 'scatter'.");
+	}
+	else
+	{
+		cfg.parallel = rir::PARALLEL_MIC;
+		cfg.num_threads = 1;
+	}
+
+	// Precision of the computation and the output (optional)
+	single = 0;
+	if (get_option_string(options, "precision", buf, sizeof(buf)))
+	{
+		if (strcmp(buf, "double") == 0)
+			single = 0;
+		else if (strcmp(buf, "single") == 0)
+			single = 1;
+		else
+			mexErrMsgTxt("Error: options.precision must be 'double' or 'single'.");
+	}
+
+	// Output type (optional)
+	image_list = 0;
+	if (get_option_string(options, "output", buf, sizeof(buf)))
+	{
+		if (strcmp(buf, "rir") == 0)
+			image_list = 0;
+		else if (strcmp(buf, "images") == 0)
+			image_list = 1;
+		else
+			mexErrMsgTxt("Error: options.output must be 'rir' or 'images'.");
+	}
+
+	// Stochastic late reverberation after this time (optional)
+	if ((opt = get_option(options, "transition")) != NULL)
+	{
+		if (mxIsEmpty(opt) || !mxIsDouble(opt) || mxGetScalar(opt) < 0)
+			mexErrMsgTxt("Invalid input arguments!");
+		cfg.transition = mxGetScalar(opt);
+	}
+
+	// Octave bands of beta (optional)
+	cfg.nr_of_bands = nr_of_bands;
+	if ((opt = get_option(options, "band_fc")) != NULL)
+	{
+		if (mxIsEmpty(opt) || !mxIsDouble(opt) || mxGetScalar(opt) <= 0)
+			mexErrMsgTxt("Invalid input arguments!");
+		cfg.band_fc = mxGetScalar(opt);
+	}
+
+	// Measured directivity of the receivers (optional)
+	if ((opt = get_option(options, "directivity")) != NULL)
+	{
+		if (mxIsEmpty(opt) || !mxIsDouble(opt) || mxIsComplex(opt) || mxGetNumberOfDimensions(opt) > 3)
+			mexErrMsgTxt("Invalid input arguments!");
+		cfg.directivity = mxGetPr(opt);
+		cfg.directivity_el = (int) mxGetDimensions(opt)[0];
+		cfg.directivity_az = (int) mxGetDimensions(opt)[1];
+		cfg.directivity_bands = (mxGetNumberOfDimensions(opt) > 2) ? (int) mxGetDimensions(opt)[2] : 1;
+	}
+
+	// Cap on the number of images per receiver and source (optional)
+	if ((opt = get_option(options, "max_images")) != NULL)
+	{
+		if (mxIsEmpty(opt) || !mxIsDouble(opt) || mxGetScalar(opt) < 0)
+			mexErrMsgTxt("Invalid input arguments!");
+		cfg.max_images = (int) mxGetScalar(opt);
+	}
+
+	// Progress of the call (optional): a function called with the fraction
+	// done, or true to print it
+	const mxArray*  progress_fn = NULL;
+	int             progress_print = 0;
+	if ((opt = get_option(options, "progress")) != NULL)
+	{
+		if (mxIsClass(opt, "function_handle"))
+			progress_fn = opt;
+		else if (!mxIsEmpty(opt) && (mxIsLogical(opt) || mxIsDouble(opt)))
+			progress_print = (int) mxGetScalar(opt);
+		else
+			mexErrMsgTxt("Invalid input arguments!");
+	}
+
+	// Report of the tables built for the call (optional)
+	verbose = 0;
+	if ((opt = get_option(options, "verbose")) != NULL)
+	{
+		if (mxIsEmpty(opt) || !(mxIsLogical(opt) || mxIsDouble(opt)))
+			mexErrMsgTxt("Invalid input arguments!");
+		verbose = (int) mxGetScalar(opt);
+	}
+
+	// Source signals to play through the responses (optional), length x N
+	const double*   signals = NULL;
+	uint64_t        signal_length = 0;
+	unsigned int    signal_block = 0;
+	if ((opt = get_option(options, "signals")) != NULL)
+	{
+		if (mxIsEmpty(opt) || !mxIsDouble(opt) || mxIsComplex(opt) || mxGetNumberOfDimensions(opt) > 2 ||
+			mxGetN(opt) != nr_of_louds)
+			mexErrMsgTxt("Invalid input arguments!");
+		if (image_list)
+			mexErrMsgTxt("Error: options.signals cannot be used with options.output 'images'.");
+		signals = mxGetPr(opt);
+		signal_length = mxGetM(opt);
+	}
+	if ((opt = get_option(options, "signal_block")) != NULL)
+	{
+		if (mxIsEmpty(opt) || !mxIsDouble(opt) || mxGetScalar(opt) < 0)
+			mexErrMsgTxt("Invalid input arguments!");
+		signal_block = (unsigned int) mxGetScalar(opt);
+	}
+
+	// File to write the responses to instead of h (optional)
+	const char*     file = NULL;
+	if ((opt = get_option(options, "file")) != NULL)
+	{
+		if (!mxIsChar(opt) || mxIsEmpty(opt) || (file = mxArrayToString(opt)) == NULL)
+			mexErrMsgTxt("Invalid input arguments!");
+		if (image_list || signals != NULL)
+			mexErrMsgTxt("Error: options.file cannot be used with options.output 'images' or options.signals.");
+	}
+
+	// The images are only collected, and the responses for the signals only
+	// computed, in double precision
+	if (image_list || signals != NULL)
+		single = 0;
+
+    // Time window length of the LPF (optional)
+    if(nrhs > 13)
+    {
+        cfg.window_l = (double) mxGetScalar(prhs[13]);
+    }
+    //Low-pass filter for interaural preservation or shifted pulses? (optional)
+    if(nrhs > 12)
+    {
+       cfg.lp_filter = (int) mxGetScalar(prhs[12]);
+    }
+	// High-pass filter (optional)
+	if (nrhs > 11)
+	{
+		cfg.hp_filter = (int) mxGetScalar(prhs[11]);
+	}
+
+	// Microphone orientation (optional): an angle, or [yaw pitch roll] or a
+	// quaternion [w x y z] for all receivers (1 row) or per receiver (M rows)
+	if (nrhs > 10 && mxGetNumberOfElements(prhs[10]) > 1)
+	{
+		if (!mxIsDouble(prhs[10]) || mxIsComplex(prhs[10]) || mxGetNumberOfDimensions(prhs[10]) > 2 ||
+			!(mxGetM(prhs[10]) == 1 || mxGetM(prhs[10]) == nr_of_mics))
+			mexErrMsgTxt("Invalid input arguments!");
+		cfg.orientation = mxGetPr(prhs[10]);
+		cfg.orientation_rows = (int) mxGetM(prhs[10]);
+		cfg.orientation_cols = (int) mxGetN(prhs[10]);
+	}
+	else if (nrhs > 10)
+	{
+		cfg.angle = (double) mxGetScalar(prhs[10]);
+	}
+
+	// Room Dimension (optional)
+	if (nrhs > 9)
+	{
+		if (!(mxGetN(prhs[9])==3) || !mxIsDouble(prhs[9]) || mxIsComplex(prhs[9]))
+        	mexErrMsgTxt("Invalid input arguments!");
+       	const double*   dim = mxGetPr(prhs[9]);
+
+        cfg.dim[0] = (dim[0] == 0) ? 0 : 1;
+        cfg.dim[1] = (dim[1] == 0) ? 0 : 1;
+        cfg.dim[2] = (dim[2] == 0) ? 0 : 1;
+    }
+
+	// Reflection order (optional)
+	if (nrhs > 8 &&  mxIsEmpty(prhs[8]) == false)
+	{
+		cfg.order = (int) mxGetScalar(prhs[8]);
+		if (cfg.order < -1)
+			mexErrMsgTxt("Invalid input arguments!");
+	}
+
+	// Type of microphone (optional), per receiver for M rows of types. The
+	// characters are stored column after column, so the first M are the
+	// first letters of the rows.
+	if (nrhs > 7 &&  mxIsEmpty(prhs[7]) == false && mxGetM(prhs[7]) > 1)
+	{
+		if (!mxIsChar(prhs[7]) || mxGetM(prhs[7]) != nr_of_mics)
+			mexErrMsgTxt("Invalid input arguments!");
+		char* mtypes = (char*) mxCalloc(mxGetNumberOfElements(prhs[7])+1, sizeof(char));
+		mxGetString(prhs[7], mtypes, mxGetNumberOfElements(prhs[7])+1);
+		cfg.mtypes = mtypes;
+	}
+	else if (nrhs > 7 &&  mxIsEmpty(prhs[7]) == false)
+	{
+		char* mtype = new char[mxGetN(prhs[7])+1];
+		mxGetString(prhs[7], mtype, mxGetN(prhs[7])+1);
+		cfg.mtype = mtype[0];
+		delete [] mtype;
+	}
+
+	// Number of samples (optional), for a batch the longest of all rooms
+	if (nrhs > 6 &&  mxIsEmpty(prhs[6]) == false)
+	{
+		cfg.nsamples = (unsigned int) mxGetScalar(prhs[6]);
+	}
+	else
+	{
+		cfg.nsamples = 0;
+		for (unsigned int k = 0 ; k < nr_of_rooms ; k++)
+		{
+			double TR;
+
+			if (nr_of_bands > 0)
+			{
+				// The longest reverberation time of the bands
+				TR = 0;
+				for (unsigned int b = 0 ; b < nr_of_bands ; b++)
+				{
+					double TR_b = rir::t60_from_beta(cfg.c, rooms[k].L, rooms[k].band_beta + 6*b, cfg.dim);
+					if (TR_b > TR)
+						TR = TR_b;
+				}
+			}
+			else if (mxGetN(prhs[5])>1)
+				TR = rir::t60_from_beta(cfg.c, rooms[k].L, rooms[k].beta, cfg.dim);
+			else
+				TR = beta_ptr[(rooms_in[3] > 1) ? k : 0];
+			if ((unsigned int) (TR * cfg.fs) > cfg.nsamples)
+				cfg.nsamples = (unsigned int) (TR * cfg.fs);
+		}
+	}
+
+	args->cfg = cfg;
+	args->rooms = rooms;
+	args->nr_of_rooms = nr_of_rooms;
+	args->nr_of_mics = nr_of_mics;
+	args->nr_of_louds = nr_of_louds;
+	args->nr_of_bands = nr_of_bands;
+	args->single = single;
+	args->image_list = image_list;
+	args->verbose = verbose;
+	args->signals = signals;
+	args->signal_length = signal_length;
+	args->signal_block = signal_block;
+	args->progress_fn = progress_fn;
+	args->progress_print = progress_print;
+	args->file = file;
+}
+
+// Config::progress of a call: stops it on Ctrl-C or when options.progress
+// fails, and lets MATLAB update its figures in between.
+struct rir_mex_progress
+{
+	const char*     name;
+	const mxArray*  fn;
+	int             print;
+	char            msg[256];       // why the call was cancelled
+};
+
+// Set while rir_mex_progress_fn runs MATLAB code. A call of this MEX file
+// from options.progress or a timer would wait for the worker pool that the
+// running call holds, or delete the session it updates, so it fails instead
+// (rir_mex_check_reentry).
+static int rir_mex_in_callback = 0;
+
+static void rir_mex_check_reentry(const char* name)
+{
+	char msg[160];
+
+	if (rir_mex_in_callback)
+	{
+		snprintf(msg, sizeof(msg), "Error: %s cannot be called from options.progress or a callback"
+			" while it runs.", name);
+		mexErrMsgTxt(msg);
+	}
+}
+
+static int rir_mex_progress_fn(double fraction, void* data)
+{
+	struct rir_mex_progress* p = (struct rir_mex_progress*) data;
+
+	if (utIsInterruptPending())
+	{
+		snprintf(p->msg, sizeof(p->msg), "Error: %s was interrupted.", p->name);
+		return 1;
+	}
+	if (p->fn != NULL)
+	{
+		mxArray* rhs[2] = { (mxArray*) p->fn, mxCreateDoubleScalar(fraction) };
+		mxArray* err;
+
+		rir_mex_in_callback = 1;
+		err = mexCallMATLABWithTrap(0, NULL, 2, rhs, "feval");
+		rir_mex_in_callback = 0;
+		mxDestroyArray(rhs[1]);
+		if (err != NULL)
+		{
+			mxArray* text = mxGetProperty(err, 0, "message");
+
+			strcpy(p->msg, "Error: options.progress stopped the call: ");
+			if (text != NULL)
+			{
+				mxGetString(text, p->msg + strlen(p->msg), sizeof(p->msg) - strlen(p->msg));
+				mxDestroyArray(text);
+			}
+			mxDestroyArray(err);
+			return 1;
+		}
+	}
+	else if (p->print)
+		mexPrintf("%s: %3.0f%%\n", p->name, 100*fraction);
+
+	// Figures are redrawn, but their callbacks wait until the call returns
+	rir_mex_in_callback = 1;
+	mexEvalString("drawnow limitrate nocallbacks;");
+	rir_mex_in_callback = 0;
+	return 0;
+}
+
+// [h, beta_hat, stats] = name(c, fs, r, s, L, beta, nsample, mtype, order, dim,
+// orientation, hp_filter, lp_filter, window_l, options), see rir_mex_parse.
+static void rir_mex_generate(const char* name, int threaded, int nlhs, mxArray *plhs[],
+	int nrhs, const mxArray *prhs[])
+{
+	struct rir_mex_args args;
+
+	rir_mex_check_reentry(name);
+	if (nlhs > 3)
+		mexErrMsgTxt("Error: Too many output arguments.");
+	if (nlhs > 2 && rir::counter_timer() == NULL)
+		mexErrMsgTxt("Error: The output stats needs rir_generator.cpp compiled with -DRIR_COUNTERS.");
+	rir_mex_parse(threaded, nrhs, prhs, &plhs[1], &args);
+
+	rir::Config&    cfg = args.cfg;
+	rir::Room*      rooms = args.rooms;
+	unsigned int    nr_of_rooms = args.nr_of_rooms;
+	unsigned int    nr_of_mics = args.nr_of_mics;
+	unsigned int    nr_of_louds = args.nr_of_louds;
+	unsigned int    nr_of_bands = args.nr_of_bands;
+	int             single = args.single;
+	int             image_list = args.image_list;
+	int             verbose = args.verbose;
+	char            msg[512];
+	struct rir_mex_progress progress;
+
+	msg[0] = 0;
+	progress.name = name;
+	progress.fn = args.progress_fn;
+	progress.print = args.progress_print;
+	progress.msg[0] = 0;
+	cfg.progress = rir_mex_progress_fn;
+	cfg.progress_data = &progress;
+
+	// Create output vector
+	int dims_out_array[4]={(int)cfg.nsamples,(int)nr_of_mics,(int)nr_of_louds,(int)nr_of_rooms};
+	uint64_t nr_of_lists = (uint64_t)nr_of_mics*nr_of_louds*nr_of_rooms;
+	struct rir_image_list* lists = NULL;
+	if (image_list)
+	{
+		mwSize dims_list[3] = {nr_of_mics, nr_of_louds, nr_of_rooms};
+		plhs[0] = mxCreateStructArray((nr_of_rooms > 1) ? 3 : 2, dims_list, 4, rir_image_fields);
+		lists = new struct rir_image_list[nr_of_lists];
+		for (uint64_t i = 0 ; i < nr_of_lists ; i++)
+			rir_image_list_init(&lists[i], cfg.max_images);
+	}
+	else if (args.file != NULL)
+		plhs[0] = mxCreateDoubleMatrix(0, 0, mxREAL);
+	else if (args.signals != NULL)
+	{
+		mwSize dims_signals[3] = {(mwSize)args.signal_length, nr_of_mics, nr_of_rooms};
+		plhs[0] = mxCreateNumericArray((nr_of_rooms > 1) ? 3 : 2, dims_signals, mxDOUBLE_CLASS, mxREAL);
+	}
+	else if (cfg.affinity != rir::AFFINITY_NONE)
+	{
+		// mxCreateNumericArray would zero the responses in this thread, which
+		// places all their pages on its node. mxMalloc leaves them unwritten, and
+		// the pinned threads zero the responses they compute (Config::first_touch).
+		mwSize dims_out[4] = {cfg.nsamples, nr_of_mics, nr_of_louds, nr_of_rooms};
+		uint64_t bytes = (uint64_t)cfg.nsamples*nr_of_lists*(single ? sizeof(float) : sizeof(double));
+		plhs[0] = mxCreateNumericMatrix(0, 0, single ? mxSINGLE_CLASS : mxDOUBLE_CLASS, mxREAL);
+		mxSetData(plhs[0], mxMalloc(bytes));
+		mxSetDimensions(plhs[0], dims_out, (nr_of_rooms > 1) ? 4 : 3);
+		cfg.first_touch = 1;
+	}
+	else
+		plhs[0] = mxCreateNumericArray((nr_of_rooms > 1) ? 4 : 3,dims_out_array,single ? mxSINGLE_CLASS : mxDOUBLE_CLASS,mxREAL);
+
+	// The worker threads stay until the MEX file is cleared
+	if (threaded)
+		mexAtExit(rir::shutdown_threads);
+
+	try
+	{
+		rir::Generator gen(cfg);
+
+		if (image_list)
+			gen.compute(rooms, nr_of_rooms, nr_of_mics, nr_of_louds, lists);
+		else if (args.file != NULL)
+			gen.compute_file(rooms, nr_of_rooms, nr_of_mics, nr_of_louds, args.file, single != 0);
+		else if (args.signals != NULL)
+		{
+			// The responses stay here; only the receiver signals are returned
+			uint64_t            rir_size = (uint64_t)cfg.nsamples*nr_of_mics*nr_of_louds;
+			std::vector<double> h(rir_size*nr_of_rooms);
+
+			gen.compute(rooms, nr_of_rooms, nr_of_mics, nr_of_louds, &h[0]);
+			if (gen.cancelled())
+				throw rir::Error(progress.msg);
+			for (unsigned int k = 0 ; k < nr_of_rooms ; k++)
+			{
+				rir::Convolver conv(&h[k*rir_size], cfg.nsamples, nr_of_mics, nr_of_louds,
+					args.signal_block, cfg.num_threads);
+				conv.convolve(args.signals, args.signal_length,
+					mxGetPr(plhs[0]) + (uint64_t)k*args.signal_length*nr_of_mics);
+			}
+		}
+		else if (single)
+			gen.compute(rooms, nr_of_rooms, nr_of_mics, nr_of_louds, (float*) mxGetData(plhs[0]));
+		else
+			gen.compute(rooms, nr_of_rooms, nr_of_mics, nr_of_louds, mxGetPr(plhs[0]));
+
+		if (gen.cancelled())
+			throw rir::Error(progress.msg);
+
+		if (verbose)
+		{
+			const rir::TableBytes& bytes = gen.table_bytes();
+			mexPrintf("%s: %u room(s), %" PRIu64 " RIR(s) per room\n", name, nr_of_rooms, (uint64_t)nr_of_mics*nr_of_louds);
+			mexPrintf("  image lattice tables: %zu bytes\n", bytes.lattice);
+			mexPrintf("  reflection gain tables: %zu bytes\n", bytes.gains);
+			mexPrintf("  LPF kernel table: %zu bytes\n", bytes.lpf);
+			if (nr_of_bands > 0)
+				mexPrintf("  octave-band filterbank: %zu bytes\n", bytes.filterbank);
+			if (cfg.transition > 0)
+				mexPrintf("  late reverberation envelopes: %zu bytes, mismatch %.2f dB\n", bytes.tail, gen.tail_mismatch());
+			if (cfg.affinity != rir::AFFINITY_NONE)
+			{
+				const std::vector<rir::Placement>& place = gen.placement();
+				for (size_t t = 0 ; t < place.size() ; t++)
+				{
+					if (place[t].cpu < 0)
+						mexPrintf("  thread %zu: not pinned\n", t);
+					else
+						mexPrintf("  thread %zu: cpu %d, node %d\n", t, place[t].cpu, place[t].node);
+				}
+			}
+		}
+
+		if (fabs(gen.tail_mismatch()) > 3)
+		{
+			char warn[160];
+			snprintf(warn, sizeof(warn), "The energy before options.transition deviates %.1f dB from the"
+				" decay of the late reverberation; a later transition fits better.", gen.tail_mismatch());
+			mexWarnMsgTxt(warn);
+		}
+
+		if (nlhs > 2)
+			plhs[2] = rir_counters_create(gen);
+	}
+	catch (const rir::Error& e)
+	{
+		strncpy(msg, e.what(), sizeof(msg)-1);
+		msg[sizeof(msg)-1] = 0;
+	}
+
+	// The MATLAB arrays of the image lists are created here, in this thread
+	if (image_list)
+	{
+		for (uint64_t i = 0 ; i < nr_of_lists ; i++)
+		{
+			if (msg[0] == 0)
+				rir_image_list_store(&lists[i], plhs[0], i);
+			rir_image_list_free(&lists[i]);
+		}
+		delete [] lists;
+	}
+	mxFree(rooms);
+	mxFree((void*) args.file);
+	if (msg[0] != 0)
+		mexErrMsgTxt(msg);
+}
+
+// Open sessions of rir_mex_session, id i at index i-1; closed ones are NULL.
+static std::vector<rir::Session*> rir_sessions;
+
+static void rir_sessions_close(void)
+{
+	for (size_t i = 0 ; i < rir_sessions.size() ; i++)
+		delete rir_sessions[i];
+	rir_sessions.clear();
+	rir::shutdown_threads();
+}
+
+// Returns the session of the id argument, or fails.
+static rir::Session* rir_session_get(const mxArray* id)
+{
+	double i = (id != NULL && mxIsDouble(id) && !mxIsEmpty(id)) ? mxGetScalar(id) : 0;
+
+	if (i < 1 || i > rir_sessions.size() || rir_sessions[(size_t)i-1] == NULL)
+		mexErrMsgTxt("Error: Invalid session id.");
+	return rir_sessions[(size_t)i-1];
+}
+
+// id = name('open', c, fs, r, s, L, beta, nsample, mtype, order, dim,
+//           orientation, hp_filter, lp_filter, window_l, options)
+// [h, nr_changed] = name('update', id, r, s, output, a)
+// name('close', id)
+static void rir_mex_session(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+	char            cmd[8];
+	char            buf[10];
+	char            msg[512];
+	struct rir_mex_progress progress;
+
+	rir_mex_check_reentry("rir_generator_session");
+	if (nrhs < 1 || !mxIsChar(prhs[0]) || mxGetString(prhs[0], cmd, sizeof(cmd)) != 0)
+		mexErrMsgTxt("Error: The first argument must be 'open', 'update' or 'close'.");
+	if (nlhs > 2)
+		mexErrMsgTxt("Error: Too many output arguments.");
+
+	msg[0] = 0;
+	progress.name = "rir_generator_session";
+	progress.fn = NULL;
+	progress.print = 0;
+	progress.msg[0] = 0;
+	if (strcmp(cmd, "open") == 0)
+	{
+		struct rir_mex_args args;
+		mxArray*        beta_hat;
+
+		rir_mex_parse(1, nrhs-1, prhs+1, &beta_hat, &args);
+		mxDestroyArray(beta_hat);
+		if (args.nr_of_rooms > 1 || args.single || args.image_list)
+			mexErrMsgTxt("Error: A session computes the responses of one room in double precision.");
+		if (args.signals != NULL || args.file != NULL)
+			mexErrMsgTxt("Error: options.signals and options.file cannot be used in a session.");
+
+		progress.fn = args.progress_fn;
+		progress.print = args.progress_print;
+		args.cfg.progress = rir_mex_progress_fn;
+		args.cfg.progress_data = &progress;
+		try
+		{
+			rir::Session* session = new rir::Session(args.cfg, args.rooms[0], args.nr_of_mics, args.nr_of_louds);
+
+			// options.progress only lives during this call
+			session->set_progress(NULL, NULL);
+			if (session->generator().cancelled())
+			{
+				delete session;
+				throw rir::Error(progress.msg);
+			}
+			rir_sessions.push_back(session);
+		}
+		catch (const rir::Error& e)
+		{
+			strncpy(msg, e.what(), sizeof(msg)-1);
+			msg[sizeof(msg)-1] = 0;
+		}
+		mxFree(args.rooms);
+		if (msg[0] != 0)
+			mexErrMsgTxt(msg);
+
+		// The sessions and the worker threads stay until the MEX file is cleared
+		mexAtExit(rir_sessions_close);
+		plhs[0] = mxCreateDoubleScalar((double) rir_sessions.size());
+	}
+	else if (strcmp(cmd, "update") == 0)
+	{
+		rir::Session*   session = rir_session_get((nrhs > 1) ? prhs[1] : NULL);
+		unsigned int    nr_of_mics = session->nr_of_mics();
+		unsigned int    nr_of_louds = session->nr_of_louds();
+		unsigned int    nsamples = session->generator().config().nsamples;
+		double          a = 0.5;
+		uint64_t        nr_changed = 0;
+
+		if (nrhs < 4 || nrhs > 6)
+			mexErrMsgTxt("Invalid input arguments!");
+
+		// The new positions, as for 'open', or [] for the same as before
+		for (int i = 2 ; i <= 3 ; i++)
+			if (!mxIsEmpty(prhs[i]) && (!mxIsDouble(prhs[i]) || mxIsComplex(prhs[i]) || mxGetN(prhs[i]) != 3 ||
+				mxGetM(prhs[i]) != ((i == 2) ? nr_of_mics : nr_of_louds)))
+				mexErrMsgTxt("Invalid input arguments!");
+
+		// Output (optional): the responses, their change or a crossfade
+		strcpy(buf, "rir");
+		if (nrhs > 4 && (!mxIsChar(prhs[4]) || mxGetString(prhs[4], buf, sizeof(buf)) != 0 ||
+			!(strcmp(buf, "rir") == 0 || strcmp(buf, "delta") == 0 || strcmp(buf, "crossfade") == 0)))
+			mexErrMsgTxt("Error: The output of 'update' must be 'rir', 'delta' or 'crossfade'.");
+		if (nrhs > 5)
+		{
+			if (mxIsEmpty(prhs[5]) || !mxIsDouble(prhs[5]))
+				mexErrMsgTxt("Invalid input arguments!");
+			a = mxGetScalar(prhs[5]);
+		}
+
+		// Ctrl-C stops the update and keeps the session as it was
+		session->set_progress(rir_mex_progress_fn, &progress);
+		try
+		{
+			nr_changed = session->update(mxIsEmpty(prhs[2]) ? session->receivers() : mxGetPr(prhs[2]),
+				mxIsEmpty(prhs[3]) ? session->sources() : mxGetPr(prhs[3]));
+			if (session->generator().cancelled())
+				throw rir::Error(progress.msg);
+		}
+		catch (const rir::Error& e)
+		{
+			strncpy(msg, e.what(), sizeof(msg)-1);
+			msg[sizeof(msg)-1] = 0;
+		}
+		session->set_progress(NULL, NULL);
+		if (msg[0] != 0)
+			mexErrMsgTxt(msg);
+
+		int dims_out_array[3]={(int)nsamples,(int)nr_of_mics,(int)nr_of_louds};
+		plhs[0] = mxCreateNumericArray(3,dims_out_array,mxDOUBLE_CLASS,mxREAL);
+		if (strcmp(buf, "delta") == 0)
+			session->delta(mxGetPr(plhs[0]));
+		else if (strcmp(buf, "crossfade") == 0)
+			session->crossfade(a, mxGetPr(plhs[0]));
+		else
+			memcpy(mxGetPr(plhs[0]), session->response(), (size_t)nsamples*nr_of_mics*nr_of_louds*sizeof(double));
+		if (nlhs > 1)
+			plhs[1] = mxCreateDoubleScalar((double) nr_changed);
+	}
+	else if (strcmp(cmd, "close") == 0)
+	{
+		rir::Session*   session = rir_session_get((nrhs > 1) ? prhs[1] : NULL);
+
+		delete session;
+		rir_sessions[(size_t)mxGetScalar(prhs[1])-1] = NULL;
+	}
+	else
+		mexErrMsgTxt("Error: The first argument must be 'open', 'update' or 'close'.");
+}
+
+// h = name(h, fs, options): the high-pass filter of hp_filter = 1 on the
+// columns of the double or single array h, returned as a copy.
+static void rir_mex_hp_filter(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+	const mxArray*  options = NULL;
+	const mxArray*  opt;
+	char            buf[10];
+	char            msg[512];
+	int             simd = rir::SIMD_AUTO;
+	int             num_threads = 0;
+	unsigned int    nsamples;
+	uint64_t        count;
+
+	if (nrhs < 2 || nrhs > 3 || nlhs > 1)
+		mexErrMsgTxt("Invalid input arguments!");
+	if (!(mxIsDouble(prhs[0]) || mxIsSingle(prhs[0])) || mxIsComplex(prhs[0]) ||
+		mxIsEmpty(prhs[1]) || !mxIsDouble(prhs[1]) || mxGetScalar(prhs[1]) <= 0)
+		mexErrMsgTxt("Invalid input arguments!");
+
+	// Options (optional)
+	if (nrhs > 2 && mxIsEmpty(prhs[2]) == false)
+	{
+		if (!mxIsStruct(prhs[2]))
+			mexErrMsgTxt("Invalid input arguments!");
+		options = prhs[2];
+	}
+
+	if (get_option_string(options, "simd", buf, sizeof(buf)) && !rir::parse_simd(buf, &simd))
+		mexErrMsgTxt("Error: options.simd must be 'auto', 'avx512', 'avx2', 'sse2', 'scalar' or 'off'.");
+	if ((opt = get_option(options, "num_threads")) != NULL)
+	{
+		if (mxIsEmpty(opt) || !mxIsDouble(opt) || mxGetScalar(opt) < 1)
+			mexErrMsgTxt("Invalid input arguments!");
+		num_threads = (int) mxGetScalar(opt);
+	}
+
+	// The first dimension holds the samples of every response
+	plhs[0] = mxDuplicateArray(prhs[0]);
+	nsamples = (unsigned int) mxGetM(prhs[0]);
+	count = (nsamples == 0) ? 0 : (uint64_t)mxGetNumberOfElements(prhs[0])/nsamples;
+
+	msg[0] = 0;
+	try
+	{
+		if (mxIsSingle(prhs[0]))
+			rir::hp_filter((float*) mxGetData(plhs[0]), nsamples, count, mxGetScalar(prhs[1]), simd, num_threads);
+		else
+			rir::hp_filter(mxGetPr(plhs[0]), nsamples, count, mxGetScalar(prhs[1]), simd, num_threads);
+	}
+	catch (const rir::Error& e)
+	{
+		strncpy(msg, e.what(), sizeof(msg)-1);
+		msg[sizeof(msg)-1] = 0;
+	}
+	if (msg[0] != 0)
+		mexErrMsgTxt(msg);
+	mexAtExit(rir::shutdown_threads);
+}
+
+#endif
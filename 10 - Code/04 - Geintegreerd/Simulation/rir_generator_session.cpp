@@ -0,0 +1,58 @@
+/*
+Program     : Room Impulse Response Generator - sessions for moving receivers
+              and sources
+
+Description : Keeps a room open between calls, for simulations in which the
+              receivers or sources move from block to block. The image
+              lattice, the reflection gain tables, the LPF kernels and the
+              envelopes of the late reverberation are built once when the
+              session is opened; an update only recomputes the responses of
+              the receiver-source pairs of which one moved (rir::Session).
+
+              Build (see rir_generator_x_threaded.cpp):
+                mex -O CXXFLAGS='$CXXFLAGS -pthread' LDFLAGS='$LDFLAGS -pthread' rir_generator_session.cpp rir_generator.cpp -lut
+*/
+
+#include "matrix.h"
+#include "mex.h"
+#include "rir_generator_mex.h"
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+	if (nrhs == 0)
+	{
+		mexPrintf("--------------------------------------------------------------------\n"
+			"| Room Impulse Response Generator sessions                         |\n"
+			"|                                                                  |\n"
+			"| Responses of a room whose receivers and sources move, updated    |\n"
+			"| for the pairs that moved only.                                   |\n"
+			"--------------------------------------------------------------------\n\n"
+			"function id = rir_generator_session('open', c, fs, r, s, L, beta, nsample, mtype,"
+			" order, dim, orientation, hp_filter, lp_filter, window_l, options);\n"
+			"function [h, nr_changed] = rir_generator_session('update', id, r, s, output, a);\n"
+			"function rir_generator_session('close', id);\n\n"
+			"'open' takes the arguments of rir_generator_x_threaded for one room, computes the"
+			" responses at the positions r and s and returns the id of the session. The"
+			" responses are computed in double precision; options.precision 'single' and"
+			" options.output 'images' cannot be used.\n"
+			"'update' moves the receivers to r (M x 3) and the sources to s (N x 3), [] for"
+			" the same positions as before, and recomputes the responses of the pairs of which"
+			" the receiver or the source moved:\n"
+			" output = 'rir' (default): h is the nsample X M X N matrix of the responses.\n"
+			"          'delta': h is the change of the responses by this update, zero for the"
+			" pairs that did not move.\n"
+			"          'crossfade': h = (1-a)*h_before + a*h_after, with a (default 0.5) going"
+			" from 0 to 1 over a block of a time-varying simulation.\n"
+			" nr_changed = the number of recomputed responses.\n"
+			"The time of an update is that of the recomputed responses; with"
+			" options.transition it is only that of their early part.\n"
+			"Ctrl-C stops 'open' or 'update', and options.progress of 'open' is called"
+			" while it computes the responses. A stopped update leaves the session at the"
+			" positions and responses before it.\n"
+			"'close' frees the session. All sessions are closed when the MEX file is"
+			" cleared.\n\n");
+		return;
+	}
+
+	rir_mex_session(nlhs, plhs, nrhs, prhs);
+}
@@ -0,0 +1,482 @@
+/*
+Program     : Room Impulse Response Generator - tests
+
+Description : Compares the modes of rir::Generator with a reference on the
+              test rooms of rir_generator_bench.cpp: the 5 x 4 x 3 m box
+              scaled by 0.5, 1 and 2 with T60 = 0.2 and 0.5 s, the receivers
+              5 cm apart around 0.3*L and the sources around 0.7*L, fs = 16
+              kHz and nsample = T60*fs, at most 2048 to keep the run short
+              (skipping the T60 the smallest room cannot have), with and
+              without the LPF. Every room is computed with 1 and with 4
+              receivers, so that the threaded mode splits the images of a
+              response as well as the responses.
+
+              "Serial" is the mode of rir_generator_x (one thread,
+              mic-parallel) and "threaded" that of rir_generator_x_threaded
+              (here 4 threads, automatic split). The errors are the largest
+              difference relative to the peak of the reference.
+
+              enum      options.enumeration 'sphere' against 'box', with every
+                        reflection order and with order 3, serial and
+                        threaded; bound 0
+              gains     options.gain_tables on against off (pow() per image),
+                        with simd 'off' and the automatic level; bound 0
+              lpf       options.lpf_oversampling 64 and 256 against the exact
+                        LPF kernel in double precision; bounds 1e-4 and 1e-5
+                        as documented in the help of rir_generator_x
+              simd      every options.simd level the CPU supports, serial and
+                        threaded, against the per-image loop (simd 'off',
+                        serial); bound 1e-12
+              single    options.precision 'single' at every supported SIMD
+                        level, serial and threaded, against double precision
+                        (serial); bound 5e-6 with the exact LPF kernel and
+                        1e-5 with lpf_oversampling = 256, whose table has an
+                        error of its own. The float sums of many images per
+                        sample dominate: up to 3e-7 in the larger rooms, 2e-6 in
+                        the smallest one
+              pool      three threads computing the rooms threaded at the
+                        same time on the shared pool, one of them stopping
+                        it between calls, against the rooms computed alone;
+                        bound 0
+              det       options.deterministic with the automatic split on
+                        the two larger rooms, with 1, 4 and 17 receivers (both
+                        sides of the 16 parts) and 1 to 32 threads (both sides
+                        of the number of responses), in double and single
+                        precision, against one thread; bound 0. In double
+                        precision also against serial; bound 1e-12, as the
+                        16 parts are summed in another order than serial
+
+              Build:
+                g++ -O2 -pthread rir_generator_test.cpp rir_generator.cpp -o rir_generator_test
+
+              Usage:
+                rir_generator_test [test ...]
+              runs the given tests, or all of them, and prints the largest
+              error of each comparison. The exit status is 1 when an error
+              exceeds its bound.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <vector>
+#include "rir_generator.h"
+
+#define TEST_THREADS 4
+#define TEST_NSAMPLES 2048
+
+struct test_room
+{
+	rir::Room           room;
+	std::vector<double> rr, ss;
+	int                 nr_of_mics;
+	int                 nr_of_louds;
+	unsigned int        nsamples;
+	char                name[64];
+};
+
+static int failures = 0;
+
+// Positions of n points 5 cm apart along x around frac*L, as in
+// rir_generator_bench.cpp.
+static std::vector<double> positions(int n, const double* L, double frac)
+{
+	std::vector<double> p(3*n);
+
+	for (int i = 0 ; i < n ; i++)
+	{
+		p[i] = frac*L[0] + 0.05*(i - 0.5*(n-1));
+		p[i + n] = frac*L[1];
+		p[i + 2*n] = frac*L[2];
+	}
+	return p;
+}
+
+static std::vector<test_room> test_rooms(int nr_of_mics)
+{
+	static const double scales[3] = { 0.5, 1, 2 };
+	static const double t60s[2] = { 0.2, 0.5 };
+	std::vector<test_room> rooms;
+
+	for (int i_s = 0 ; i_s < 3 ; i_s++)
+		for (int i_t = 0 ; i_t < 2 ; i_t++)
+		{
+			test_room t;
+
+			for (int i = 0 ; i < 3 ; i++)
+				t.room.L[i] = scales[i_s]*((i == 0) ? 5 : (i == 1) ? 4 : 3);
+			// As in the benchmark, a T60 that the room cannot have is skipped
+			try
+			{
+				double beta = rir::beta_from_t60(343, t.room.L, t60s[i_t]);
+				for (int i = 0 ; i < 6 ; i++)
+					t.room.beta[i] = beta;
+			}
+			catch (const rir::Error&)
+			{
+				continue;
+			}
+			t.nr_of_mics = nr_of_mics;
+			t.nr_of_louds = 1;
+			t.nsamples = (unsigned int) fmin(t60s[i_t]*16000, TEST_NSAMPLES);
+			t.rr = positions(t.nr_of_mics, t.room.L, 0.3);
+			t.ss = positions(t.nr_of_louds, t.room.L, 0.7);
+			snprintf(t.name, sizeof(t.name), "L=%gx%gx%g T60=%g M=%d",
+				t.room.L[0], t.room.L[1], t.room.L[2], t60s[i_t], nr_of_mics);
+			rooms.push_back(t);
+		}
+	return rooms;
+}
+
+// The settings of the MEX files for a room, serial or threaded.
+static rir::Config test_config(const test_room& t, int threaded, int lp_filter)
+{
+	rir::Config cfg;
+
+	cfg.fs = 16000;
+	cfg.nsamples = t.nsamples;
+	cfg.lp_filter = lp_filter;
+	cfg.parallel = threaded ? rir::PARALLEL_AUTO : rir::PARALLEL_MIC;
+	cfg.num_threads = threaded ? TEST_THREADS : 1;
+	return cfg;
+}
+
+template <typename T>
+static std::vector<T> compute(const rir::Config& cfg, test_room& t)
+{
+	std::vector<T> h((size_t)t.nsamples*t.nr_of_mics*t.nr_of_louds, 0);
+	rir::Generator gen(cfg);
+
+	t.room.r = &t.rr[0];
+	t.room.s = &t.ss[0];
+	gen.compute(&t.room, 1, t.nr_of_mics, t.nr_of_louds, &h[0]);
+	return h;
+}
+
+// Largest difference of h from ref relative to the peak of ref.
+template <typename T>
+static double max_error(const std::vector<T>& h, const std::vector<double>& ref)
+{
+	double peak = 0, err = 0;
+
+	for (size_t i = 0 ; i < ref.size() ; i++)
+	{
+		peak = fmax(peak, fabs(ref[i]));
+		err = fmax(err, fabs((double)h[i] - ref[i]));
+	}
+	return (peak > 0) ? err/peak : err;
+}
+
+static void check(const char* test, const char* what, double err, double bound)
+{
+	int ok = (err <= bound);
+
+	printf("%-6s %-60s %9.2e %s\n", test, what, err, ok ? "ok" : "FAILED");
+	if (!ok)
+		failures++;
+}
+
+// The images inside the sphere against the full image box.
+static void test_enum()
+{
+	for (int nr_of_mics = 1 ; nr_of_mics <= 4 ; nr_of_mics += 3)
+	{
+		std::vector<test_room> rooms = test_rooms(nr_of_mics);
+
+		for (size_t r = 0 ; r < rooms.size() ; r++)
+			for (int lp_filter = 0 ; lp_filter <= 1 ; lp_filter++)
+				for (int order = -1 ; order <= 3 ; order += 4)
+					for (int threaded = 0 ; threaded <= 1 ; threaded++)
+					{
+						rir::Config cfg = test_config(rooms[r], threaded, lp_filter);
+						char what[128];
+
+						cfg.order = order;
+						cfg.enumeration = rir::ENUM_BOX;
+						std::vector<double> ref = compute<double>(cfg, rooms[r]);
+						cfg.enumeration = rir::ENUM_SPHERE;
+						snprintf(what, sizeof(what), "%s lp=%d order=%d %s", rooms[r].name, lp_filter,
+							order, threaded ? "threaded" : "serial");
+						check("enum", what, max_error(compute<double>(cfg, rooms[r]), ref), 0);
+					}
+	}
+}
+
+// The reflection gains from the per-wall tables against pow() per image.
+static void test_gains()
+{
+	for (int nr_of_mics = 1 ; nr_of_mics <= 4 ; nr_of_mics += 3)
+	{
+		std::vector<test_room> rooms = test_rooms(nr_of_mics);
+
+		for (size_t r = 0 ; r < rooms.size() ; r++)
+			for (int lp_filter = 0 ; lp_filter <= 1 ; lp_filter++)
+				for (int off = 0 ; off <= 1 ; off++)
+				{
+					rir::Config cfg = test_config(rooms[r], 0, lp_filter);
+					char what[128];
+
+					cfg.simd = off ? rir::SIMD_OFF : rir::SIMD_AUTO;
+					cfg.gain_tables = 0;
+					std::vector<double> ref = compute<double>(cfg, rooms[r]);
+					cfg.gain_tables = 1;
+					snprintf(what, sizeof(what), "%s lp=%d %s", rooms[r].name, lp_filter, off ? "off" : "auto");
+					check("gains", what, max_error(compute<double>(cfg, rooms[r]), ref), 0);
+				}
+	}
+}
+
+// The tabulated LPF kernel against the exact one.
+static void test_lpf()
+{
+	static const int    oversampling[2] = { 64, 256 };
+	static const double bounds[2] = { 1e-4, 1e-5 };
+
+	for (int nr_of_mics = 1 ; nr_of_mics <= 4 ; nr_of_mics += 3)
+	{
+		std::vector<test_room> rooms = test_rooms(nr_of_mics);
+
+		for (size_t r = 0 ; r < rooms.size() ; r++)
+		{
+			rir::Config cfg = test_config(rooms[r], 0, 1);
+			std::vector<double> ref = compute<double>(cfg, rooms[r]);
+
+			for (int i = 0 ; i < 2 ; i++)
+			{
+				char what[128];
+
+				cfg.lpf_oversampling = oversampling[i];
+				snprintf(what, sizeof(what), "%s P=%d", rooms[r].name, oversampling[i]);
+				check("lpf", what, max_error(compute<double>(cfg, rooms[r]), ref), bounds[i]);
+			}
+		}
+	}
+}
+
+// Every SIMD level against the per-image reference loop.
+static void test_simd()
+{
+	static const int   levels[5] = { rir::SIMD_OFF, rir::SIMD_SCALAR, rir::SIMD_SSE2, rir::SIMD_AVX2, rir::SIMD_AVX512 };
+	static const char* names[5] = { "off", "scalar", "sse2", "avx2", "avx512" };
+
+	for (int nr_of_mics = 1 ; nr_of_mics <= 4 ; nr_of_mics += 3)
+	{
+		std::vector<test_room> rooms = test_rooms(nr_of_mics);
+
+		for (size_t r = 0 ; r < rooms.size() ; r++)
+			for (int lp_filter = 0 ; lp_filter <= 1 ; lp_filter++)
+			{
+				rir::Config cfg = test_config(rooms[r], 0, lp_filter);
+				cfg.simd = rir::SIMD_OFF;
+				std::vector<double> ref = compute<double>(cfg, rooms[r]);
+
+				for (int l = 0 ; l < 5 ; l++)
+					for (int threaded = 0 ; threaded <= 1 ; threaded++)
+					{
+						char what[128];
+
+						cfg = test_config(rooms[r], threaded, lp_filter);
+						cfg.simd = levels[l];
+						snprintf(what, sizeof(what), "%s lp=%d %s %s", rooms[r].name, lp_filter,
+							names[l], threaded ? "threaded" : "serial");
+						try
+						{
+							check("simd", what, max_error(compute<double>(cfg, rooms[r]), ref), 1e-12);
+						}
+						catch (const rir::Error&)
+						{
+							printf("%-6s %-60s not supported\n", "simd", what);
+						}
+					}
+			}
+	}
+}
+
+// Single against double precision.
+static void test_single()
+{
+	static const int   levels[4] = { rir::SIMD_SCALAR, rir::SIMD_SSE2, rir::SIMD_AVX2, rir::SIMD_AVX512 };
+	static const char* names[4] = { "scalar", "sse2", "avx2", "avx512" };
+
+	for (int nr_of_mics = 1 ; nr_of_mics <= 4 ; nr_of_mics += 3)
+	{
+		std::vector<test_room> rooms = test_rooms(nr_of_mics);
+
+		for (size_t r = 0 ; r < rooms.size() ; r++)
+			for (int lp_filter = 0 ; lp_filter <= 1 ; lp_filter++)
+				for (int oversampling = 0 ; oversampling <= (lp_filter ? 256 : 0) ; oversampling += 256)
+				{
+					rir::Config cfg = test_config(rooms[r], 0, lp_filter);
+					std::vector<double> ref = compute<double>(cfg, rooms[r]);
+
+					for (int l = 0 ; l < 4 ; l++)
+						for (int threaded = 0 ; threaded <= 1 ; threaded++)
+						{
+							char what[128];
+
+							cfg = test_config(rooms[r], threaded, lp_filter);
+							cfg.simd = levels[l];
+							cfg.lpf_oversampling = oversampling;
+							snprintf(what, sizeof(what), "%s lp=%d%s %s %s", rooms[r].name, lp_filter,
+								oversampling ? " table" : "", names[l], threaded ? "threaded" : "serial");
+							try
+							{
+								check("single", what, max_error(compute<float>(cfg, rooms[r]), ref),
+									oversampling ? 1e-5 : 5e-6);
+							}
+							catch (const rir::Error&)
+							{
+								printf("%-6s %-60s not supported\n", "single", what);
+							}
+						}
+				}
+	}
+}
+
+struct pool_caller
+{
+	std::vector<test_room>*             rooms;
+	std::vector<std::vector<double> >*  refs;
+	int                                 shutdown;   // stop the pool after every call
+	double                              err;
+};
+
+static void* pool_caller_run(void* arg)
+{
+	struct pool_caller* c = (struct pool_caller*) arg;
+
+	for (int rep = 0 ; rep < 3 ; rep++)
+		for (size_t r = 0 ; r < c->rooms->size() ; r++)
+		{
+			test_room t = (*c->rooms)[r];
+			c->err = fmax(c->err, max_error(compute<double>(test_config(t, 1, 1), t), (*c->refs)[r]));
+			if (c->shutdown)
+				rir::shutdown_threads();
+		}
+	return NULL;
+}
+
+// Generators in different threads share the pool and take turns on it.
+static void test_pool()
+{
+	std::vector<test_room> rooms = test_rooms(1);
+	std::vector<test_room> more = test_rooms(4);
+	std::vector<std::vector<double> > refs;
+	struct pool_caller     callers[3];
+	pthread_t              threads[3];
+
+	rooms.insert(rooms.end(), more.begin(), more.end());
+	for (size_t r = 0 ; r < rooms.size() ; r++)
+		refs.push_back(compute<double>(test_config(rooms[r], 1, 1), rooms[r]));
+
+	for (int i = 0 ; i < 3 ; i++)
+	{
+		callers[i].rooms = &rooms;
+		callers[i].refs = &refs;
+		callers[i].shutdown = (i == 2);
+		callers[i].err = 0;
+		pthread_create(&threads[i], NULL, pool_caller_run, &callers[i]);
+	}
+	for (int i = 0 ; i < 3 ; i++)
+	{
+		char what[64];
+
+		pthread_join(threads[i], NULL);
+		snprintf(what, sizeof(what), "caller %d%s", i, callers[i].shutdown ? " (stops the pool)" : "");
+		check("pool", what, callers[i].err, 0);
+	}
+}
+
+// Config::deterministic gives the same result for every number of threads.
+static void test_det()
+{
+	static const int threads[6] = { 1, 2, 3, 4, 5, 32 };
+	static const int mics[3] = { 1, 4, 17 };
+
+	for (int i_m = 0 ; i_m < 3 ; i_m++)
+	{
+		std::vector<test_room> rooms = test_rooms(mics[i_m]);
+
+		for (size_t r = 0 ; r < rooms.size() ; r++)
+		{
+			// The smallest room has the most images and would take long
+			if (rooms[r].room.L[0] < 5)
+				continue;
+
+			rir::Config cfg = test_config(rooms[r], 0, 1);
+			std::vector<double> serial = compute<double>(cfg, rooms[r]);
+			std::vector<double> ref;
+			std::vector<float>  ref_f;
+			char what[128];
+
+			cfg = test_config(rooms[r], 1, 1);
+			cfg.deterministic = 1;
+			cfg.num_threads = 1;
+			ref = compute<double>(cfg, rooms[r]);
+			ref_f = compute<float>(cfg, rooms[r]);
+			snprintf(what, sizeof(what), "%s 1 thread against serial", rooms[r].name);
+			check("det", what, max_error(ref, serial), 1e-12);
+
+			for (int i_t = 1 ; i_t < 6 ; i_t++)
+			{
+				std::vector<double> h;
+				std::vector<float>  h_f;
+				double              err = 0;
+
+				cfg.num_threads = threads[i_t];
+				h = compute<double>(cfg, rooms[r]);
+				h_f = compute<float>(cfg, rooms[r]);
+				for (size_t i = 0 ; i < ref.size() ; i++)
+					err = fmax(err, fmax(fabs(h[i] - ref[i]), fabs((double)h_f[i] - ref_f[i])));
+				snprintf(what, sizeof(what), "%s %d threads against 1", rooms[r].name, threads[i_t]);
+				check("det", what, err, 0);
+			}
+		}
+	}
+}
+
+static const struct
+{
+	const char* name;
+	void        (*run)();
+} tests[] =
+{
+	{ "enum", test_enum },
+	{ "gains", test_gains },
+	{ "lpf", test_lpf },
+	{ "simd", test_simd },
+	{ "single", test_single },
+	{ "pool", test_pool },
+	{ "det", test_det },
+};
+
+int main(int argc, char* argv[])
+{
+	const int nr_of_tests = sizeof(tests)/sizeof(tests[0]);
+
+	for (int a = 1 ; a < argc ; a++)
+	{
+		int known = 0;
+		for (int i = 0 ; i < nr_of_tests ; i++)
+			known |= (strcmp(argv[a], tests[i].name) == 0);
+		if (!known)
+		{
+			fprintf(stderr, "Error: unknown test %s, see the header of rir_generator_test.cpp.\n", argv[a]);
+			return 2;
+		}
+	}
+
+	for (int i = 0 ; i < nr_of_tests ; i++)
+	{
+		int run = (argc == 1);
+		for (int a = 1 ; a < argc ; a++)
+			run |= (strcmp(argv[a], tests[i].name) == 0);
+		if (run)
+			tests[i].run();
+	}
+
+	rir::shutdown_threads();
+	printf("%d comparison(s) failed\n", failures);
+	return (failures > 0) ? 1 : 0;
+}
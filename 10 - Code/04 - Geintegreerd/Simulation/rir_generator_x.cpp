@@ -61,68 +61,13 @@ along with this program; if not, write to the Free Software
 Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 */
 
-#define _USE_MATH_DEFINES
-
 #include "matrix.h"
 #include "mex.h"
-#include "math.h"
-
-#define ROUND(x) ((x)>=0?(long)((x)+0.5):(long)((x)-0.5))
-
-double sinc(double x)
-{
-	if (x == 0)
-		return(1.);
-	else
-		return(sin(x)/x);
-}
-
-double sim_microphone(double x, double y, double angle, char* mtype)
-{
-	double a, refl_theta, P, PG;
+#include "rir_generator_mex.h"
 
-	refl_theta = atan2(y,x) - angle;
-
-	// Polar Pattern         P       PG
-	// ------------------------------------
-	// Omnidirectional       1       0
-	// Subcardioid           0.75    0.25
-	// Cardioid              0.5     0.5
-	// Hypercardioid         0.25    0.75
-	// Bidirectional         0       1
-
-	switch(mtype[0])
-	{
-	case 'o':
-		P = 1;
-		PG = 0;
-		break;
-	case 's':
-		P = 0.75;
-		PG = 0.25;
-		break;
-	case 'c':
-		P = 0.5;
-		PG = 0.5;
-		break;
-	case 'h':
-		P = 0.25;
-		PG = 0.75;
-		break;
-	case 'b':
-		P = 0;
-		PG = 1;
-		break;
-	default:
-		P = 1;
-		PG = 0;
-		break;
-	};
-
-	a = P + PG * cos(refl_theta);
-
-	return a;
-}
+// The image-method engine is in rir_generator.cpp; compile with
+//   mex -O CXXFLAGS='$CXXFLAGS -pthread' LDFLAGS='$LDFLAGS -pthread' rir_generator_x.cpp rir_generator.cpp -lut
+// and add -DRIR_COUNTERS for the third output (stats).
 
 void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
 {
@@ -151,8 +96,8 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
 			"|     acoustic source in a reverberant room, Journal Acoustic      |\n"
 			"|     Society of America, 80(5), November 1986.                    |\n"
 			"--------------------------------------------------------------------\n\n"
-			"function [h, beta_hat] = rir_generator(c, fs, r, s, L, beta, nsample, mtype,"
-			" order, dim, orientation, hp_filter, lp_filter, window_l);\n\n"
+			"function [h, beta_hat, stats] = rir_generator(c, fs, r, s, L, beta, nsample, mtype,"
+			" order, dim, orientation, hp_filter, lp_filter, window_l, options);\n\n"
 			"Input parameters:\n"
 			" c  = sound velocity in m/s.\n"
 			" fs = sampling frequency in Hz.\n"
@@ -161,386 +106,114 @@ void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
 			" L  = 1 x 3 vector specifying the room dimensions (x,y,z) in m.\n"
 			" beta = 1 x 6 vector specifying the reflection coefficients"
 			" [beta_x1 beta_x2 beta_y1 beta_y2\n"
-			"      beta_z1 beta_z2] or beta = Reverberation Time (T_60) in seconds.\n"
+			"      beta_z1 beta_z2] or beta = Reverberation Time (T_60) in seconds, or a 6 x B"
+			" matrix with the 6 coefficients of B octave bands as its columns, see"
+			" options.band_fc.\n"
 			" nsample = number of samples to calculate, default is T_60*fs.\n"
 			" mtype = [omnidirectional, subcardioid, cardioid, hypercardioid, bidirectional],"
-			" default is omnidirectional.\n"
+			" default is omnidirectional, or an M x n char matrix with the type of every"
+			" receiver in its row (['o';'c';'c']).\n"
 			" order = reflection order, default is -1, i.e. maximum order).\n"
 			" dim = room dimension. 1 x 3 boolean vector which specifies if the room space"
             " is defined over the corresponding Cartesian coordinate ([X Y Z]).\n"
 			" orientation = specifies the angle (in rad) in which the microphone is pointed,"
-			" default is 0.\n"
+			" default is 0. For microphones that are not level, such as phones at any pitch"
+			" and roll, a 1 x 3 [yaw pitch roll] in rad (the rotation"
+			" Rz(yaw)*Ry(pitch)*Rx(roll) of the room axes) or a 1 x 4 quaternion [w x y z],"
+			" or M x 3 or M x 4 with one row per receiver. The receiver then points along its"
+			" rotated x axis, and mtype and options.directivity use the 3-D direction of the"
+			" images relative to its axes instead of their azimuth only.\n"
 			" hp_filter = use 'false' to disable high-pass filter, the high-pass filter is"
-			" enabled by default.\n"
+			" enabled by default. rir_hp_filter applies it to responses computed without it.\n"
             " lp_filter = use 'false' to disable low-pass filtering of the pulses and use"
             " rounding of the arrival time in the impulse responses (Allen & Berkley) original"
             " algorithm, the low_pass filter is enabled by default.\n"
-            " window_l = Time length (in  seconds) of the Hanning window used in the LPF.\n\n"
+            " window_l = Time length (in  seconds) of the Hanning window used in the LPF.\n"
+			" options = structure with optional engine settings:\n"
+			"   .gain_tables = use 'false' to compute the reflection gains with pow() for every"
+			" image instead of looking them up in per-wall tables built once per call (default"
+			" 'true', identical results).\n"
+			"   .lpf_oversampling = number of fractional delays per sample P at which the"
+			" windowed-sinc LPF kernel is tabulated once per call. Kernels for other delays are"
+			" linearly interpolated between the two nearest table rows, which replaces the"
+			" window_l*fs sinc() calls per reflection by a multiply-add, at an error that"
+			" falls with 1/P^2 (relative to the response peak: below 1e-4 for P = 64 and 1e-5 for P = 256)"
+			" and a speed-up of about 5x for the default window. The table holds"
+			" (P+1)*(window_l*fs+1) values. Default is 0, the exact kernel.\n"
+			"   .simd = instruction set of the vectorized image kernels: 'auto' (default, the"
+			" widest one the CPU supports), 'avx512', 'avx2', 'sse2', 'scalar' (same batching"
+			" without vector instructions) or 'off' (the reference per-image loop). All give"
+			" identical results.\n"
+			"   .precision = 'double' (default) or 'single'. In single precision the output is a"
+			" single array of half the size, and the LPF kernels and their accumulation into"
+			" the response run in float, twice as many per vector. The image positions and"
+			" arrival times stay in double. The error is about 1e-7 relative to the response"
+			" peak. With 'off', the batched loop without vector instructions is used.\n"
+			"   .output = 'rir' (default) or 'images', which returns the images that arrive"
+			" within nsample samples instead of the responses, without building them.\n"
+			"   .transition = time in s up to which the images are computed (default 0, the whole"
+			" response). The rest is Gaussian noise under the mean energy decay of the image"
+			" method for beta and L, with its level fitted to the last 40 ms before the"
+			" transition, so that the cost no longer grows with the cube of nsample. A warning"
+			" is given when the energy before the transition deviates more than 3 dB from the"
+			" decay, which means that the reflections are not yet diffuse there. Not for output"
+			" 'images' or a room with dim set to 0.\n"
+			"   .band_fc = centre frequency in Hz of the first octave band of a 6 x B beta"
+			" (default 125); the bands are centred at band_fc*2.^(0:B-1), and the highest"
+			" crossover, at sqrt(2) times the centre of band B-1, must be below fs/2. Every image"
+			" is computed once and its pulse is added with the reflection gains of each band to"
+			" a response per band, which are combined by a zero-phase filterbank with"
+			" crossovers at sqrt(2) times the centre frequencies, so that B bands cost less than"
+			" B calls. The default nsample follows from the band with the longest T_60. Not for"
+			" output 'images' or with transition. A 6 x 6 beta needs band_fc, as"
+			" rir_generator_x_threaded reads it as a batch of 6 rooms otherwise.\n"
+			"   .directivity = measured gains of the receivers, used instead of mtype: an E x A"
+			" matrix on a uniform grid of polar angles pi*(0:E-1)/(E-1) from the z axis (rows)"
+			" and azimuths 2*pi*(0:A-1)/A from the orientation (columns), both taken from the"
+			" receiver's own axes with a 3-D orientation, or E x A x B with one"
+			" page per octave band of beta. The gain of every image is interpolated bilinearly"
+			" between the four nearest directions. Measurements on another grid, such as"
+			" Directivity/NX506_*.mat, are first resampled to this one (interp2) and reduced"
+			" from an impulse response to a gain (per band) per direction.\n"
+			"   .max_images = with output 'images', keep only this many of the earliest images"
+			" per receiver and source (default 0, all). The reflection order is capped with"
+			" the order argument.\n"
+			"   .signals = length x N source signals, one column per source: h is then the"
+			" signals at the receivers, the sum over the sources of the signals convolved with"
+			" their responses (fftfilt per response, as in simRec2.m), and the responses are"
+			" not returned. The convolution is partitioned into FFT blocks, parallel over the"
+			" receivers and blocks; the responses are computed in double precision.\n"
+			"   .signal_block = length of the FFT blocks of the convolution, a power of two"
+			" (default 0, the smallest one of at least nsample, at most 8192).\n"
+			"   .file = name of a file to write the responses to instead of h, for responses"
+			" that do not fit in the memory: the threads write them through a memory mapping of"
+			" the file, as float32 with options.precision 'single' and float64 otherwise, after"
+			" a header of 64 bytes (see rir_file.h). h is then []. Open the file with"
+			" rir_memmap.m.\n"
+			"   .progress = a function called as f(fraction) about every 0.1 s while the images"
+			" are added, with the fraction of the work done, e.g. @(x) waitbar(x, hbar); an"
+			" error in it stops the call, as does calling this function again from it. Use"
+			" 'true' to print the percentage instead. MATLAB redraws its figures in between,"
+			" but runs their callbacks only after the call, and Ctrl-C stops the call with an"
+			" error in any case.\n"
+			"   .verbose = use 'true' to print the memory used by the tables that are built once"
+			" per call and shared by all receivers and sources (default 'false').\n\n"
 			"Output parameters:\n"
 			" h = nsample X M X N matrix containing the calculated room impulse response(s).\n"
+			"     With options.signals, the length X M signals of the receivers.\n"
+			"     With output 'images', an M X N structure array with per receiver and source"
+			" the K images earliest first: delay (K x 1, arrival time in samples), gain"
+			" (K x 1, amplitude including directivity and distance), order (K x 1, number of"
+			" reflections) and hits (K x 6, reflections on the walls x1 x2 y1 y2 z1 z2).\n"
 			" beta_hat = In case a reverberation time is specified as an input parameter the "
-			"corresponding reflection coefficient is returned.\n\n");
+			"corresponding reflection coefficient is returned.\n"
+			" stats = Only when compiled with -DRIR_COUNTERS: the work of the call, with the"
+			" fields tasks, images_visited, images_rejected_order, images_rejected_distance,"
+			" images_accepted, taps_written and the times cycles_total, cycles_images, cycles_lpf,"
+			" cycles_scatter, cycles_hp_filter, cycles_reduce and cycles_filterbank in units of timer ('tsc' or"
+			" 'ns').\n\n");
 		return;
 	}
-	// Check for proper number of arguments
-	if (nrhs < 6)
-		mexErrMsgTxt("Error: There are at least six input parameters required.");
-	if (nrhs > 14)
-		mexErrMsgTxt("Error: Too many input arguments.");
-	if (nlhs > 2)
-		mexErrMsgTxt("Error: Too many output arguments.");
-
-	// Check for proper arguments
-	if (!(mxGetN(prhs[0])==1) || !mxIsDouble(prhs[0]) || mxIsComplex(prhs[0]))
-		mexErrMsgTxt("Invalid input arguments!");
-	if (!(mxGetN(prhs[1])==1) || !mxIsDouble(prhs[1]) || mxIsComplex(prhs[1]))
-		mexErrMsgTxt("Invalid input arguments!");
-	if (!(mxGetN(prhs[2])==3) || !mxIsDouble(prhs[2]) || mxIsComplex(prhs[2]))
-		mexErrMsgTxt("Invalid input arguments!");
-	if (!(mxGetN(prhs[3])==3) || !mxIsDouble(prhs[3]) || mxIsComplex(prhs[3]))
-		mexErrMsgTxt("Invalid input arguments!");
-	if (!(mxGetN(prhs[4])==3) || !mxIsDouble(prhs[4]) || mxIsComplex(prhs[4]))
-		mexErrMsgTxt("Invalid input arguments!");
-	if (!(mxGetN(prhs[5])==6 || mxGetN(prhs[5])==1) || !mxIsDouble(prhs[5]) || mxIsComplex(prhs[5]))
-		mexErrMsgTxt("Invalid input arguments!");
-
-	// Load parameters
-	double          c = mxGetScalar(prhs[0]);
-	double          fs = mxGetScalar(prhs[1]);
-	const double*   rr = mxGetPr(prhs[2]);
-	int             nr_of_mics = (int) mxGetM(prhs[2]);
-	const double*   ss = mxGetPr(prhs[3]);
-	int             nr_of_louds = (int) mxGetM(prhs[3]);
-	const double*   LL = mxGetPr(prhs[4]);
-	const double*   beta_ptr = mxGetPr(prhs[5]);
-	double*         beta = new double[6];
-	int             nsamples;
-	char*           mtype;
-	int             order;
-	int             dim;
-	double          angle;
-	int             hp_filter;
-    int             lp_filter;
-	double          TR;
-    double          Wl;
-   	int*            dim_s = new int[3];
-    
-	plhs[1] = mxCreateDoubleMatrix(1, 1, mxREAL);
-	double* beta_hat = mxGetPr(plhs[1]);
-	beta_hat[0] = 0;
-
-	// Reflection coefficients or Reverberation Time?
-	if (mxGetN(prhs[5])==1)
-	{
-		double V = LL[0]*LL[1]*LL[2];
-		double S = 2*(LL[0]*LL[2]+LL[1]*LL[2]+LL[0]*LL[1]);
-		TR = beta_ptr[0];
-		double alfa = 24*V*log(10.0)/(c*S*TR);
-		if (alfa > 1)
-			mexErrMsgTxt("Error: The reflection coefficients cannot be calculated using the current "
-				"room parameters, i.e. room size and reverberation time.\n           Please "
-				"specify the reflection coefficients or change the room parameters.");
-		beta_hat[0] = sqrt(1-alfa);
-		for (int i=0;i<6;i++)
-			beta[i] = beta_hat[0];
-	}
-	else
-	{
-		for (int i=0;i<6;i++)
-			beta[i] = beta_ptr[i];
-	}
-
-    // Time window length of the LPF (optional)
-    if(nrhs > 13)
-    {
-        Wl = (double) mxGetScalar(prhs[13]);
-    }
-    else
-    {
-        Wl=0.008;   //8ms default.
-    }
-    //Low-pass filter for interaural preservation or shifted pulses? (optional)
-    if(nrhs > 12)
-    {
-       lp_filter = (int) mxGetScalar(prhs[12]);
-    }
-    else
-    {
-       lp_filter = 1;
-    }
-	// High-pass filter (optional)
-	if (nrhs > 11)
-	{
-		hp_filter = (int) mxGetScalar(prhs[11]);
-	}
-	else
-	{
-		hp_filter = 1;
-	}
-
-	// Microphone orientation (optional)
-	if (nrhs > 10)
-	{
-		angle = (double) mxGetScalar(prhs[10]);
-	}
-	else
-	{
-		angle = 0;
-	}
-
-	// Room Dimension (optional)
-	if (nrhs > 9)
-	{
-		if (!(mxGetN(prhs[9])==3) || !mxIsDouble(prhs[9]) || mxIsComplex(prhs[9]))
-        	mexErrMsgTxt("Invalid input arguments!");
-       	const double*   dim = mxGetPr(prhs[9]);
-        
-		
-        if (dim[0] == 0)
-		{
-			beta[0] = 0;
-			beta[1] = 0;
-            dim_s[0] = 0;
-		}
-        else
-        {
-            dim_s[0] = 1;
-        }
-        
-        if (dim[1] == 0)
-		{
-			beta[2] = 0;
-			beta[3] = 0;
-            dim_s[1] = 0;
-		}
-        else
-        {
-            dim_s[1] = 1;
-        }
-
-        if (dim[2] == 0)
-		{
-			beta[4] = 0;
-			beta[5] = 0;
-            dim_s[2] = 0;            
-		}
-        else
-        {
-            dim_s[2] = 1;
-        }
-    }
-    else
-    {
-        dim_s[0] = 1;
-        dim_s[1] = 1;
-        dim_s[2] = 1;    
-    }
-	// Reflection order (optional)
-	if (nrhs > 8 &&  mxIsEmpty(prhs[8]) == false)
-	{
-		order = (int) mxGetScalar(prhs[8]);
-		if (order < -1)
-			mexErrMsgTxt("Invalid input arguments!");
-	}
-	else
-	{
-		order = -1;
-	}
-
-	// Type of microphone (optional)
-	if (nrhs > 7 &&  mxIsEmpty(prhs[7]) == false)
-	{
-		mtype = new char[mxGetN(prhs[7])+1];
-		mxGetString(prhs[7], mtype, mxGetN(prhs[7])+1);
-	}
-	else
-	{
-		mtype = new char[1];
-		mtype[0] = 'o';
-	}
 
-	// Number of samples (optional)
-	if (nrhs > 6 &&  mxIsEmpty(prhs[6]) == false)
-	{
-		nsamples = (int) mxGetScalar(prhs[6]);
-	}
-	else
-	{
-		if (mxGetN(prhs[5])>1)
-		{
-			double V = LL[0]*LL[1]*LL[2];
-			double S = 2*(LL[0]*LL[2]+LL[1]*LL[2]+LL[0]*LL[1]);
-			double alpha = ((1-pow(beta[0],2))+(1-pow(beta[1],2)))*LL[0]*LL[2] +
-				((1-pow(beta[2],2))+(1-pow(beta[3],2)))*LL[1]*LL[2] +
-				((1-pow(beta[4],2))+(1-pow(beta[5],2)))*LL[0]*LL[1];
-			TR = 24*log(10.0)*V/(c*alpha);
-			if (TR < 0.128)
-				TR = 0.128;
-		}
-		nsamples = (int) (TR * fs);
-	}
-
-	// Create output vector
-	
-	int dims_out_array[3]={nsamples,nr_of_mics,nr_of_louds};
-	plhs[0] = mxCreateNumericArray(3,dims_out_array,mxDOUBLE_CLASS,mxREAL);
-	double* imp = mxGetPr(plhs[0]);
-
-	// Temporary variables and constants (high-pass filter)
-	const double W = 2*M_PI*100/fs;
-	const double R1 = exp(-W);
-	const double R2 = R1;
-	const double B1 = 2*R1*cos(W);
-	const double B2 = -R1 * R1;
-	const double A1 = -(1+R2);
-	const double A2 = R2;
-	double       X0, Y0, Y1, Y2;
-
-	// Temporary variables and constants (image-method)
-	const double Fc = 1;
-	const int    Tw = (ROUND(Wl*fs) < 1) ? 1 : ROUND(Wl*fs);
-	const double cTs = c/fs;
-	double*      hanning_window = new double[Tw+1];
-	double*      LPI = new double[Tw+1];
-	double*      r = new double[3];
-	double*      s = new double[3];
-	double*      L = new double[3];
-	double       hu[6];
-	double       refl[3];
-	double       dist;
-	double       ll;
-	double       strength;
-	int          pos, fdist;
-	int          n1,n2,n3;
-	int          q, j, k;
-	int          mx, my, mz;
-	int          n;
-
-	L[0] = LL[0]/cTs; L[1] = LL[1]/cTs; L[2] = LL[2]/cTs;
-
-	// Hanning window
-	for (n = 0 ; n < Tw+1 ; n++)
-	{
-		hanning_window[n] = 0.5 * (1 + cos(2*M_PI*(n+Tw/2)/Tw));
-	}
-	
-	int abs_counter=0;
-
-	for (int loud_nr = 0; loud_nr < nr_of_louds; loud_nr++ )	
-	{	
-		
-			s[0] = ss[loud_nr + 0*nr_of_louds] / cTs;
-			s[1] = ss[loud_nr + 1*nr_of_louds] / cTs;
-			s[2] = ss[loud_nr + 2*nr_of_louds] / cTs;
-        	
-		for (int mic_nr = 0; mic_nr < nr_of_mics ; mic_nr++)
-		{
-			// [x_1 x_2 ... x_N y_1 y_2 ... y_N z_1 z_2 ... z_N]
-			r[0] = rr[mic_nr + 0*nr_of_mics] / cTs;
-			r[1] = rr[mic_nr + 1*nr_of_mics] / cTs;
-			r[2] = rr[mic_nr + 2*nr_of_mics] / cTs;
-	
-			n1 = ceil(nsamples/(2*L[0]))*dim_s[0];
-			n2 = ceil(nsamples/(2*L[1]))*dim_s[1];
-			n3 = ceil(nsamples/(2*L[2]))*dim_s[2];
-	
-			// Generate room impulse response
-			for (mx = -n1 ; mx <= n1 ; mx++)
-			{
-				hu[0] = 2*mx*L[0];
-		
-	
-				for (my = -n2 ; my <= n2 ; my++)
-				{
-					hu[1] = 2*my*L[1];
-	
-					for (mz = -n3 ; mz <= n3 ; mz++)
-					{
-						hu[2] = 2*mz*L[2];
-	
-						for (q = 0 ; q <= 1*dim_s[0] ; q++)
-						{
-                            hu[3] = s[0] - r[0] + 2*q*r[0] + hu[0];
-							refl[0] = pow(beta[0], abs(mx)) * pow(beta[1], abs(mx+q));
-							
-                            for (j = 0 ; j <= 1*dim_s[1] ; j++)
-							{
-								hu[4] = s[1] - r[1] + 2*j*r[1] + hu[1];
-								refl[1] = pow(beta[2], abs(my)) * pow(beta[3], abs(my+j));
-	
-								for (k = 0 ; k <= 1*dim_s[2] ; k++)
-								{
-									hu[5] = s[2] - r[2] + 2*k*r[2] + hu[2];
-									refl[2] = pow(beta[4],abs(mz)) * pow(beta[5], abs(mz+k));
-	
-									dist = sqrt(pow(hu[3], 2) + pow(hu[4], 2) + pow(hu[5], 2));
-	
-									fdist = (int) floor(dist);
-									if (abs(2*mx+q)+abs(2*my+j)+abs(2*mz+k) <= order || order == -1)
-									{
-										if (fdist < nsamples)
-										{
-											
-                                            //if ( mx == 0 && my == 0 && mz == 0 && q == 0 && j == 0 && k==0)
-                                            //{
-                                            //    mexPrintf("x: %f | y: %f | z: %f \n",refl[0],refl[1],refl[2]);
-                                            //}
-                                            
-                                            strength = sim_microphone(hu[3], hu[4], angle, mtype)
-												* refl[0]*refl[1]*refl[2]/(4*M_PI*dist*cTs);
-	
-                                            //if ( mx == 0 && my == 0 && mz == 0 && q == 0 && j == 0 && k==0)
-                                            //{
-                                            //    mexPrintf("str: %f | dist: %f | dist*cTs: %f \n",strength,dist,dist*cTs);
-                                            //}
-                                            
-                                            
-                                            
-											if (lp_filter == 1)
-                                            {
-                                                for (n = 0 ; n < Tw+1 ; n++)
-                                                    LPI[n] = hanning_window[n] * Fc * sinc( M_PI*Fc*(n-(dist-fdist)-(Tw/2)) );
-
-                                                pos = fdist-(Tw/2);
-                                                for (n = 0; n < Tw+1; n++)
-                                                {    
-                                                  if (pos+n >=0 && pos+n < nsamples)
-                                                  {
-                                                    //if ( mx == 0 && my == 0 && mz == 0)
-                                                      imp[ abs_counter + (pos+n)] += strength * LPI[n];
-                                                  }
-                                                }
-                                            }
-                                            else
-                                            {
-                                                //if ( mx == 0 && my == 0 && mz == 0)
-                                                imp[ abs_counter + fdist] += strength;
-                                            }
-										}
-									}
-								}
-							}
-						}
-					}
-				}
-			}
-	
-			// 'Original' high-pass filter as proposed by Allen and Berkley.
-			if (hp_filter == 1)
-			{
-				Y0 = 0;
-				Y1 = 0;
-				Y2 = 0;
-				for (int idx = 0 ; idx < nsamples ; idx++)
-				{
-					X0 = imp[ abs_counter + idx];
-					Y2 = Y1;
-					Y1 = Y0;
-					Y0 = B1*Y1 + B2*Y2 + X0;
-					imp[ abs_counter + idx] = Y0 + A1*Y1 + A2*Y2;                    
-				}
-			}
-			abs_counter+=nsamples;
-		}
-	}
+	rir_mex_generate("rir_generator_x", 0, nlhs, plhs, nrhs, prhs);
 }
@@ -0,0 +1,50 @@
+/*
+Program     : Room Impulse Response Generator - high-pass filter
+
+Description : The 'original' high-pass filter proposed by Allen and Berkley
+              [1] that rir_generator_x(_threaded) applies with hp_filter = 1,
+              for responses computed with hp_filter = 0 or measured ones.
+              The responses are filtered several at a time in vector lanes
+              and over the threads (rir::hp_filter), with the same result as
+              the filter of rir_generator_x.
+
+              [1] J.B. Allen and D.A. Berkley,
+              Image method for efficiently simulating small-room Acoustics,
+              Journal Acoustic Society of America, 65(4), April 1979, p 943.
+
+              Build (see rir_generator_x_threaded.cpp):
+                mex -O CXXFLAGS='$CXXFLAGS -pthread' LDFLAGS='$LDFLAGS -pthread' rir_hp_filter.cpp rir_generator.cpp -lut
+*/
+
+#include "matrix.h"
+#include "mex.h"
+#include "rir_generator_mex.h"
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+	if (nrhs == 0)
+	{
+		mexPrintf("--------------------------------------------------------------------\n"
+			"| Room Impulse Response Generator high-pass filter                 |\n"
+			"|                                                                  |\n"
+			"| The high-pass filter of Allen and Berkley (hp_filter = 1) for    |\n"
+			"| responses that have already been computed or measured.           |\n"
+			"--------------------------------------------------------------------\n\n"
+			"function h = rir_hp_filter(h, fs, options);\n\n"
+			"Input parameters:\n"
+			" h  = nsample X ... array of responses in double or single precision, e.g. the"
+			" nsample X M X N output of rir_generator_x with hp_filter = 0. Every column is"
+			" filtered.\n"
+			" fs = sampling frequency in Hz.\n"
+			" options = structure with optional fields:\n"
+			"   .simd = instruction set of the filter as for rir_generator_x: 'auto' (default),"
+			" 'avx512', 'avx2', 'sse2', 'scalar' or 'off' (one response at a time). All give"
+			" the same result.\n"
+			"   .num_threads = number of threads (default: all cores).\n\n"
+			"Output parameters:\n"
+			" h = the filtered responses, of the size and class of the input.\n\n");
+		return;
+	}
+
+	rir_mex_hp_filter(nlhs, plhs, nrhs, prhs);
+}
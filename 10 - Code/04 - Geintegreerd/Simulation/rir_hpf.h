@@ -0,0 +1,372 @@
+/*
+Program     : Room Impulse Response Generator - high-pass filter
+
+Description : The 'original' high-pass filter proposed by Allen and Berkley
+              [1], a biquad with its zeros at DC and its poles at 100 Hz,
+              for responses of nsamples samples stored one after the other.
+              One response is a chain of dependent multiplications and
+              additions, so the kernels filter several responses at once,
+              one per vector lane, and two vectors of them so that their
+              chains overlap too: blocks of samples of the lanes are loaded
+              per response, transposed so that a vector holds the same
+              sample of every lane, filtered, and transposed back.
+
+              Every kernel performs the same IEEE operations in the same
+              order per response as the scalar filter of rir_generator_x.cpp
+              (no fused multiply-add), so the result does not depend on the
+              level or on how the responses are grouped. The filter state is
+              kept in double precision for float responses as well.
+
+              [1] J.B. Allen and D.A. Berkley,
+              Image method for efficiently simulating small-room Acoustics,
+              Journal Acoustic Society of America, 65(4), April 1979, p 943.
+*/
+
+#ifndef RIR_HPF_H
+#define RIR_HPF_H
+
+#include <stdint.h>
+#include "math.h"
+#include "rir_simd.h"
+
+// Responses filtered at once by the plain C kernel
+#define RIR_HPF_LANES 4
+
+struct rir_hpf
+{
+	double  b1, b2;         // feedback of the poles
+	double  a1, a2;         // feedforward of the zeros
+};
+
+static void rir_hpf_init(struct rir_hpf* f, double fs)
+{
+	const double W = 2*M_PI*100/fs;
+	const double R1 = exp(-W);
+	const double R2 = R1;
+
+	f->b1 = 2*R1*cos(W);
+	f->b2 = -R1 * R1;
+	f->a1 = -(1+R2);
+	f->a2 = R2;
+}
+
+// One response at a time as in rir_generator_x.cpp: samples from .. nsamples-1
+// of the response at h, with y0 and y1 the outputs of the poles at the two
+// samples before.
+static void rir_hpf_one(const struct rir_hpf* f, double* h, unsigned int from, unsigned int nsamples,
+	double y0, double y1)
+{
+	double       X0, Y0, Y1, Y2;
+
+	Y0 = y0;
+	Y1 = y1;
+	for (unsigned int idx = from ; idx < nsamples ; idx++)
+	{
+		X0 = h[idx];
+		Y2 = Y1;
+		Y1 = Y0;
+		Y0 = f->b1*Y1 + f->b2*Y2 + X0;
+		h[idx] = Y0 + f->a1*Y1 + f->a2*Y2;
+	}
+}
+
+static void rir_hpf_one_f(const struct rir_hpf* f, float* h, unsigned int from, unsigned int nsamples,
+	double y0, double y1)
+{
+	double       X0, Y0, Y1, Y2;
+
+	Y0 = y0;
+	Y1 = y1;
+	for (unsigned int idx = from ; idx < nsamples ; idx++)
+	{
+		X0 = h[idx];
+		Y2 = Y1;
+		Y1 = Y0;
+		Y0 = f->b1*Y1 + f->b2*Y2 + X0;
+		h[idx] = (float) (Y0 + f->a1*Y1 + f->a2*Y2);
+	}
+}
+
+// The plain C kernel: RIR_HPF_LANES responses sample by sample, so that the
+// chains of the lanes overlap.
+static void rir_hpf_lanes(const struct rir_hpf* f, double* h, unsigned int nsamples)
+{
+	double       Y0[RIR_HPF_LANES], Y1[RIR_HPF_LANES], Y2[RIR_HPF_LANES];
+
+	for (int l = 0 ; l < RIR_HPF_LANES ; l++)
+		Y0[l] = Y1[l] = Y2[l] = 0.0;
+	for (unsigned int idx = 0 ; idx < nsamples ; idx++)
+		for (int l = 0 ; l < RIR_HPF_LANES ; l++)
+		{
+			double* x = h + (uint64_t)l*nsamples + idx;
+			Y2[l] = Y1[l];
+			Y1[l] = Y0[l];
+			Y0[l] = f->b1*Y1[l] + f->b2*Y2[l] + *x;
+			*x = Y0[l] + f->a1*Y1[l] + f->a2*Y2[l];
+		}
+}
+
+static void rir_hpf_lanes_f(const struct rir_hpf* f, float* h, unsigned int nsamples)
+{
+	double       Y0[RIR_HPF_LANES], Y1[RIR_HPF_LANES], Y2[RIR_HPF_LANES];
+
+	for (int l = 0 ; l < RIR_HPF_LANES ; l++)
+		Y0[l] = Y1[l] = Y2[l] = 0.0;
+	for (unsigned int idx = 0 ; idx < nsamples ; idx++)
+		for (int l = 0 ; l < RIR_HPF_LANES ; l++)
+		{
+			float* x = h + (uint64_t)l*nsamples + idx;
+			Y2[l] = Y1[l];
+			Y1[l] = Y0[l];
+			Y0[l] = f->b1*Y1[l] + f->b2*Y2[l] + (double)*x;
+			*x = (float) (Y0[l] + f->a1*Y1[l] + f->a2*Y2[l]);
+		}
+}
+
+#ifdef RIR_SIMD_X86
+
+// One sample of every lane of the state y0, y1, y2: x in, the output in x.
+#define RIR_HPF_STEP(add, mul, x, y0, y1, y2) \
+	y2 = y1; \
+	y1 = y0; \
+	y0 = add(add(mul(b1, y1), mul(b2, y2)), x); \
+	x = add(add(y0, mul(a1, y1)), mul(a2, y2));
+
+// Transposes the 2 x 2 block r0, r1 in place.
+#define RIR_HPF_TRANSPOSE2(r0, r1) \
+	{ \
+		__m128d t0 = _mm_unpacklo_pd(r0, r1); \
+		r1 = _mm_unpackhi_pd(r0, r1); \
+		r0 = t0; \
+	}
+
+// Four responses as two pairs, so that two chains overlap; blocks of two
+// samples.
+__attribute__((target("sse2")))
+static void rir_hpf_sse2(const struct rir_hpf* f, double* h, unsigned int nsamples)
+{
+	const __m128d b1 = _mm_set1_pd(f->b1), b2 = _mm_set1_pd(f->b2);
+	const __m128d a1 = _mm_set1_pd(f->a1), a2 = _mm_set1_pd(f->a2);
+	__m128d       y0 = _mm_setzero_pd(), y1 = y0, y2 = y0;
+	__m128d       z0 = y0, z1 = y0, z2 = y0;
+	double*       h1 = h + nsamples;
+	double*       h2 = h1 + nsamples;
+	double*       h3 = h2 + nsamples;
+	double        s0[4], s1[4];
+	unsigned int  n;
+
+	for (n = 0 ; n + 2 <= nsamples ; n += 2)
+	{
+		__m128d c0 = _mm_loadu_pd(h + n);
+		__m128d c1 = _mm_loadu_pd(h1 + n);
+		__m128d d0 = _mm_loadu_pd(h2 + n);
+		__m128d d1 = _mm_loadu_pd(h3 + n);
+
+		RIR_HPF_TRANSPOSE2(c0, c1)
+		RIR_HPF_TRANSPOSE2(d0, d1)
+		RIR_HPF_STEP(_mm_add_pd, _mm_mul_pd, c0, y0, y1, y2)
+		RIR_HPF_STEP(_mm_add_pd, _mm_mul_pd, d0, z0, z1, z2)
+		RIR_HPF_STEP(_mm_add_pd, _mm_mul_pd, c1, y0, y1, y2)
+		RIR_HPF_STEP(_mm_add_pd, _mm_mul_pd, d1, z0, z1, z2)
+		RIR_HPF_TRANSPOSE2(c0, c1)
+		RIR_HPF_TRANSPOSE2(d0, d1)
+		_mm_storeu_pd(h + n, c0);
+		_mm_storeu_pd(h1 + n, c1);
+		_mm_storeu_pd(h2 + n, d0);
+		_mm_storeu_pd(h3 + n, d1);
+	}
+	_mm_storeu_pd(s0, y0);
+	_mm_storeu_pd(s0 + 2, z0);
+	_mm_storeu_pd(s1, y1);
+	_mm_storeu_pd(s1 + 2, z1);
+	for (int l = 0 ; l < 4 ; l++)
+		rir_hpf_one(f, h + (uint64_t)l*nsamples, n, nsamples, s0[l], s1[l]);
+}
+
+__attribute__((target("sse2")))
+static void rir_hpf_f_sse2(const struct rir_hpf* f, float* h, unsigned int nsamples)
+{
+	const __m128d b1 = _mm_set1_pd(f->b1), b2 = _mm_set1_pd(f->b2);
+	const __m128d a1 = _mm_set1_pd(f->a1), a2 = _mm_set1_pd(f->a2);
+	__m128d       y0 = _mm_setzero_pd(), y1 = y0, y2 = y0;
+	__m128d       z0 = y0, z1 = y0, z2 = y0;
+	float*        h1 = h + nsamples;
+	float*        h2 = h1 + nsamples;
+	float*        h3 = h2 + nsamples;
+	double        s0[4], s1[4];
+	unsigned int  n;
+
+	for (n = 0 ; n + 2 <= nsamples ; n += 2)
+	{
+		__m128d c0 = _mm_cvtps_pd(_mm_loadl_pi(_mm_setzero_ps(), (const __m64*)(h + n)));
+		__m128d c1 = _mm_cvtps_pd(_mm_loadl_pi(_mm_setzero_ps(), (const __m64*)(h1 + n)));
+		__m128d d0 = _mm_cvtps_pd(_mm_loadl_pi(_mm_setzero_ps(), (const __m64*)(h2 + n)));
+		__m128d d1 = _mm_cvtps_pd(_mm_loadl_pi(_mm_setzero_ps(), (const __m64*)(h3 + n)));
+
+		RIR_HPF_TRANSPOSE2(c0, c1)
+		RIR_HPF_TRANSPOSE2(d0, d1)
+		RIR_HPF_STEP(_mm_add_pd, _mm_mul_pd, c0, y0, y1, y2)
+		RIR_HPF_STEP(_mm_add_pd, _mm_mul_pd, d0, z0, z1, z2)
+		RIR_HPF_STEP(_mm_add_pd, _mm_mul_pd, c1, y0, y1, y2)
+		RIR_HPF_STEP(_mm_add_pd, _mm_mul_pd, d1, z0, z1, z2)
+		RIR_HPF_TRANSPOSE2(c0, c1)
+		RIR_HPF_TRANSPOSE2(d0, d1)
+		_mm_storel_pi((__m64*)(h + n), _mm_cvtpd_ps(c0));
+		_mm_storel_pi((__m64*)(h1 + n), _mm_cvtpd_ps(c1));
+		_mm_storel_pi((__m64*)(h2 + n), _mm_cvtpd_ps(d0));
+		_mm_storel_pi((__m64*)(h3 + n), _mm_cvtpd_ps(d1));
+	}
+	_mm_storeu_pd(s0, y0);
+	_mm_storeu_pd(s0 + 2, z0);
+	_mm_storeu_pd(s1, y1);
+	_mm_storeu_pd(s1 + 2, z1);
+	for (int l = 0 ; l < 4 ; l++)
+		rir_hpf_one_f(f, h + (uint64_t)l*nsamples, n, nsamples, s0[l], s1[l]);
+}
+
+// Transposes the 4 x 4 block r0..r3 in place.
+#define RIR_HPF_TRANSPOSE4(r0, r1, r2, r3) \
+	{ \
+		__m256d t0 = _mm256_unpacklo_pd(r0, r1); \
+		__m256d t1 = _mm256_unpackhi_pd(r0, r1); \
+		__m256d t2 = _mm256_unpacklo_pd(r2, r3); \
+		__m256d t3 = _mm256_unpackhi_pd(r2, r3); \
+		r0 = _mm256_permute2f128_pd(t0, t2, 0x20); \
+		r1 = _mm256_permute2f128_pd(t1, t3, 0x20); \
+		r2 = _mm256_permute2f128_pd(t0, t2, 0x31); \
+		r3 = _mm256_permute2f128_pd(t1, t3, 0x31); \
+	}
+
+// Four samples of the eight responses from h: c0..c3 of the first four, d0..d3
+// of the others, after the transpose sample k of every lane in ck and dk.
+#define RIR_HPF_AVX2_BLOCK(c, d) \
+	RIR_HPF_TRANSPOSE4(c[0], c[1], c[2], c[3]) \
+	RIR_HPF_TRANSPOSE4(d[0], d[1], d[2], d[3]) \
+	for (int k = 0 ; k < 4 ; k++) \
+	{ \
+		RIR_HPF_STEP(_mm256_add_pd, _mm256_mul_pd, c[k], y0, y1, y2) \
+		RIR_HPF_STEP(_mm256_add_pd, _mm256_mul_pd, d[k], z0, z1, z2) \
+	} \
+	RIR_HPF_TRANSPOSE4(c[0], c[1], c[2], c[3]) \
+	RIR_HPF_TRANSPOSE4(d[0], d[1], d[2], d[3])
+
+// Eight responses as two groups of four in blocks of four samples.
+__attribute__((target("avx2")))
+static void rir_hpf_avx2(const struct rir_hpf* f, double* h, unsigned int nsamples)
+{
+	const __m256d b1 = _mm256_set1_pd(f->b1), b2 = _mm256_set1_pd(f->b2);
+	const __m256d a1 = _mm256_set1_pd(f->a1), a2 = _mm256_set1_pd(f->a2);
+	__m256d       y0 = _mm256_setzero_pd(), y1 = y0, y2 = y0;
+	__m256d       z0 = y0, z1 = y0, z2 = y0;
+	__m256d       c[4], d[4];
+	double        s0[8], s1[8];
+	unsigned int  n;
+
+	for (n = 0 ; n + 4 <= nsamples ; n += 4)
+	{
+		for (int l = 0 ; l < 4 ; l++)
+		{
+			c[l] = _mm256_loadu_pd(h + (uint64_t)l*nsamples + n);
+			d[l] = _mm256_loadu_pd(h + (uint64_t)(l+4)*nsamples + n);
+		}
+		RIR_HPF_AVX2_BLOCK(c, d)
+		for (int l = 0 ; l < 4 ; l++)
+		{
+			_mm256_storeu_pd(h + (uint64_t)l*nsamples + n, c[l]);
+			_mm256_storeu_pd(h + (uint64_t)(l+4)*nsamples + n, d[l]);
+		}
+	}
+	_mm256_storeu_pd(s0, y0);
+	_mm256_storeu_pd(s0 + 4, z0);
+	_mm256_storeu_pd(s1, y1);
+	_mm256_storeu_pd(s1 + 4, z1);
+	for (int l = 0 ; l < 8 ; l++)
+		rir_hpf_one(f, h + (uint64_t)l*nsamples, n, nsamples, s0[l], s1[l]);
+}
+
+__attribute__((target("avx2")))
+static void rir_hpf_f_avx2(const struct rir_hpf* f, float* h, unsigned int nsamples)
+{
+	const __m256d b1 = _mm256_set1_pd(f->b1), b2 = _mm256_set1_pd(f->b2);
+	const __m256d a1 = _mm256_set1_pd(f->a1), a2 = _mm256_set1_pd(f->a2);
+	__m256d       y0 = _mm256_setzero_pd(), y1 = y0, y2 = y0;
+	__m256d       z0 = y0, z1 = y0, z2 = y0;
+	__m256d       c[4], d[4];
+	double        s0[8], s1[8];
+	unsigned int  n;
+
+	for (n = 0 ; n + 4 <= nsamples ; n += 4)
+	{
+		for (int l = 0 ; l < 4 ; l++)
+		{
+			c[l] = _mm256_cvtps_pd(_mm_loadu_ps(h + (uint64_t)l*nsamples + n));
+			d[l] = _mm256_cvtps_pd(_mm_loadu_ps(h + (uint64_t)(l+4)*nsamples + n));
+		}
+		RIR_HPF_AVX2_BLOCK(c, d)
+		for (int l = 0 ; l < 4 ; l++)
+		{
+			_mm_storeu_ps(h + (uint64_t)l*nsamples + n, _mm256_cvtpd_ps(c[l]));
+			_mm_storeu_ps(h + (uint64_t)(l+4)*nsamples + n, _mm256_cvtpd_ps(d[l]));
+		}
+	}
+	_mm256_storeu_pd(s0, y0);
+	_mm256_storeu_pd(s0 + 4, z0);
+	_mm256_storeu_pd(s1, y1);
+	_mm256_storeu_pd(s1 + 4, z1);
+	for (int l = 0 ; l < 8 ; l++)
+		rir_hpf_one_f(f, h + (uint64_t)l*nsamples, n, nsamples, s0[l], s1[l]);
+}
+
+#endif
+
+// Responses filtered at once by the kernel of a level; AVX-512 uses the AVX2
+// kernel, as a wider vector only lengthens the transposes.
+static int rir_hpf_width(int level)
+{
+	if (level == RIR_SIMD_OFF)
+		return 1;
+#ifdef RIR_SIMD_X86
+	if (level == RIR_SIMD_AVX2 || level == RIR_SIMD_AVX512)
+		return 8;
+#endif
+	return RIR_HPF_LANES;
+}
+
+// Filters the count responses from h in place with the kernel of the given
+// level (RIR_SIMD_*); what is left of count after the groups of its width
+// with the plain C kernel and one at a time.
+static void rir_hpf_apply(const struct rir_hpf* f, int level, double* h, unsigned int nsamples, uint64_t count)
+{
+	const int width = rir_hpf_width(level);
+	uint64_t  i = 0;
+
+#ifdef RIR_SIMD_X86
+	for ( ; width == 8 && i + 8 <= count ; i += 8)
+		rir_hpf_avx2(f, h + i*nsamples, nsamples);
+	for ( ; level == RIR_SIMD_SSE2 && i + 4 <= count ; i += 4)
+		rir_hpf_sse2(f, h + i*nsamples, nsamples);
+#endif
+	for ( ; width > 1 && i + RIR_HPF_LANES <= count ; i += RIR_HPF_LANES)
+		rir_hpf_lanes(f, h + i*nsamples, nsamples);
+	for ( ; i < count ; i++)
+		rir_hpf_one(f, h + i*nsamples, 0, nsamples, 0.0, 0.0);
+}
+
+static void rir_hpf_apply_f(const struct rir_hpf* f, int level, float* h, unsigned int nsamples, uint64_t count)
+{
+	const int width = rir_hpf_width(level);
+	uint64_t  i = 0;
+
+#ifdef RIR_SIMD_X86
+	for ( ; width == 8 && i + 8 <= count ; i += 8)
+		rir_hpf_f_avx2(f, h + i*nsamples, nsamples);
+	for ( ; level == RIR_SIMD_SSE2 && i + 4 <= count ; i += 4)
+		rir_hpf_f_sse2(f, h + i*nsamples, nsamples);
+#endif
+	for ( ; width > 1 && i + RIR_HPF_LANES <= count ; i += RIR_HPF_LANES)
+		rir_hpf_lanes_f(f, h + i*nsamples, nsamples);
+	for ( ; i < count ; i++)
+		rir_hpf_one_f(f, h + i*nsamples, 0, nsamples, 0.0, 0.0);
+}
+
+#endif
@@ -0,0 +1,142 @@
+/*
+Program     : Room Impulse Response Generator - image lists
+
+Description : Collects the images that arrive at one receiver from one source
+              (arrival time, gain and the number of reflections on every wall)
+              for the 'images' output of rir::Generator. The MEX files store
+              them in a MATLAB structure (rir_generator_mex.h).
+
+              With a cap on the number of images only the earliest ones are
+              kept, in a max-heap on the arrival time, so that the memory
+              used per receiver does not grow with the number of images.
+*/
+
+#ifndef RIR_IMAGE_LIST_H
+#define RIR_IMAGE_LIST_H
+
+#include "stdlib.h"
+
+struct rir_image
+{
+	double delay;       // arrival time in samples
+	double gain;
+	int    hits[6];     // reflections on the walls x1 x2 y1 y2 z1 z2
+};
+
+struct rir_image_list
+{
+	struct rir_image* images;
+	int               nr_of_images;
+	int               size;
+	int               max_images;   // 0 = no cap
+	int               failed;       // an image was dropped for lack of memory
+};
+
+static void rir_image_list_init(struct rir_image_list* list, int max_images)
+{
+	list->images = NULL;
+	list->nr_of_images = 0;
+	list->size = 0;
+	list->max_images = max_images;
+	list->failed = 0;
+}
+
+static inline void rir_image_list_free(struct rir_image_list* list)
+{
+	free(list->images);
+	rir_image_list_init(list, list->max_images);
+}
+
+// Orders images by arrival time, and by the wall hits for equal times so
+// that the order does not depend on the order in which they were found.
+static int rir_image_cmp(const void* a, const void* b)
+{
+	const struct rir_image* ia = (const struct rir_image*)a;
+	const struct rir_image* ib = (const struct rir_image*)b;
+
+	if (ia->delay != ib->delay)
+		return (ia->delay < ib->delay) ? -1 : 1;
+	for (int i = 0 ; i < 6 ; i++)
+		if (ia->hits[i] != ib->hits[i])
+			return (ia->hits[i] < ib->hits[i]) ? -1 : 1;
+	return 0;
+}
+
+static void rir_image_sift_up(struct rir_image* heap, int i)
+{
+	while (i > 0 && rir_image_cmp(&heap[(i-1)/2], &heap[i]) < 0)
+	{
+		struct rir_image tmp = heap[i];
+		heap[i] = heap[(i-1)/2];
+		heap[(i-1)/2] = tmp;
+		i = (i-1)/2;
+	}
+}
+
+static void rir_image_sift_down(struct rir_image* heap, int n, int i)
+{
+	while (1)
+	{
+		int largest = i;
+		if (2*i+1 < n && rir_image_cmp(&heap[2*i+1], &heap[largest]) > 0)
+			largest = 2*i+1;
+		if (2*i+2 < n && rir_image_cmp(&heap[2*i+2], &heap[largest]) > 0)
+			largest = 2*i+2;
+		if (largest == i)
+			break;
+		struct rir_image tmp = heap[i];
+		heap[i] = heap[largest];
+		heap[largest] = tmp;
+		i = largest;
+	}
+}
+
+// Adds the image (mx, my, mz) with parities (q, j, k), arriving after delay
+// samples with the given gain. Returns 0 when out of memory.
+static int rir_image_list_add(struct rir_image_list* list, double delay, double gain,
+	int mx, int q, int my, int j, int mz, int k)
+{
+	struct rir_image img;
+
+	img.delay = delay;
+	img.gain = gain;
+	img.hits[0] = abs(mx);
+	img.hits[1] = abs(mx+q);
+	img.hits[2] = abs(my);
+	img.hits[3] = abs(my+j);
+	img.hits[4] = abs(mz);
+	img.hits[5] = abs(mz+k);
+
+	// Full heap: replace the latest image if this one arrives earlier
+	if (list->max_images > 0 && list->nr_of_images == list->max_images)
+	{
+		if (rir_image_cmp(&img, &list->images[0]) < 0)
+		{
+			list->images[0] = img;
+			rir_image_sift_down(list->images, list->nr_of_images, 0);
+		}
+		return 1;
+	}
+
+	if (list->nr_of_images == list->size)
+	{
+		int size = (list->size == 0) ? 64 : 2*list->size;
+		if (list->max_images > 0 && size > list->max_images)
+			size = list->max_images;
+		struct rir_image* images = (struct rir_image*) realloc(list->images, size*sizeof(struct rir_image));
+		if (images == NULL)
+		{
+			list->failed = 1;
+			return 0;
+		}
+		list->images = images;
+		list->size = size;
+	}
+
+	list->images[list->nr_of_images++] = img;
+	if (list->max_images > 0)
+		rir_image_sift_up(list->images, list->nr_of_images-1);
+	return 1;
+}
+
+#endif
@@ -0,0 +1,68 @@
+/*
+Program     : Room Impulse Response Generator - image lattice tables
+
+Description : The parts of the image method that only depend on the room and
+              on the image indices (mx, my, mz) and parities (q, j, k): the
+              lattice offsets 2*m*L and the reflection gains per axis. They
+              are the same for every source and receiver, so the engine in
+              rir_generator.cpp builds them once per room and lets all
+              (source, receiver) pairs read them.
+*/
+
+#ifndef RIR_LATTICE_H
+#define RIR_LATTICE_H
+
+#include "math.h"
+#include "stdlib.h"
+
+struct rir_lattice
+{
+	int     n[3];           // image indices m = -n[i] .. n[i] along axis i
+	double* offset[3];      // 2*m*L[i], at index m+n[i]
+	double* refl[3][2];     // gain of the two walls of axis i for parity p
+	size_t  bytes;          // memory held by the tables
+};
+
+// Builds the tables for a room of dimensions L (in samples) and responses of
+// nsamples samples. The gains come from the per-wall power tables beta_pow
+// when given, and from pow() otherwise, with the same products as the image
+// loops so that the results do not change.
+static void rir_lattice_build(struct rir_lattice* lat, unsigned int nsamples, const double* L,
+	const int* dim_s, const double* beta, double** beta_pow)
+{
+	lat->bytes = 0;
+	for (int i = 0 ; i < 3 ; i++)
+	{
+		int n = (int) (ceil(nsamples/(2*L[i]))*dim_s[i]);
+
+		lat->n[i] = n;
+		lat->offset[i] = new double[2*n+1];
+		for (int m = -n ; m <= n ; m++)
+			lat->offset[i][m+n] = 2*m*L[i];
+
+		for (int p = 0 ; p < 2 ; p++)
+		{
+			lat->refl[i][p] = new double[2*n+1];
+			for (int m = -n ; m <= n ; m++)
+			{
+				if (beta_pow != NULL)
+					lat->refl[i][p][m+n] = beta_pow[2*i][abs(m)] * beta_pow[2*i+1][abs(m+p)];
+				else
+					lat->refl[i][p][m+n] = pow(beta[2*i], abs(m)) * pow(beta[2*i+1], abs(m+p));
+			}
+		}
+		lat->bytes += 3*(2*n+1)*sizeof(double);
+	}
+}
+
+static void rir_lattice_free(struct rir_lattice* lat)
+{
+	for (int i = 0 ; i < 3 ; i++)
+	{
+		delete [] lat->offset[i];
+		delete [] lat->refl[i][0];
+		delete [] lat->refl[i][1];
+	}
+}
+
+#endif
@@ -0,0 +1,48 @@
+function [m, info] = rir_memmap(file, writable)
+%   This function opens a file written by rir_generator_x(_threaded) with
+%   options.file as a memmapfile, so that the responses can be read without
+%   loading all of them into memory. The layout is described in rir_file.h.
+%
+%   Inputs
+%   file        Name of the file
+%   writable    Map the file writable (default false)
+%
+%   Output
+%   m           memmapfile with m.Data.h the nsample x M x N x K responses,
+%               e.g. m.Data.h(:,3,1,1) for receiver 3 and source 1
+%   info        Header: nsamples, nr_of_mics, nr_of_louds, nr_of_rooms, fs,
+%               precision ('single' or 'double') and complete (false when
+%               the call was stopped before all responses were written)
+
+if nargin < 2, writable = false; end
+
+fid = fopen(file, 'r');
+if fid < 0
+    error('Cannot open %s.', file);
+end
+magic = fread(fid, 8, 'uint8=>uint8').';
+header_size = fread(fid, 1, 'uint32');
+sample_size = fread(fid, 1, 'uint32');
+dims = fread(fid, 4, 'uint64');
+info.fs = fread(fid, 1, 'double');
+info.complete = fread(fid, 1, 'uint32') == 1;
+fclose(fid);
+
+if ~isequal(magic, uint8(['RIRGEN' 0 1]))
+    error('%s is not a response file of rir_generator.', file);
+end
+info.nsamples = dims(1);
+info.nr_of_mics = dims(2);
+info.nr_of_louds = dims(3);
+info.nr_of_rooms = dims(4);
+if sample_size == 4
+    info.precision = 'single';
+else
+    info.precision = 'double';
+end
+if ~info.complete
+    warning('%s was not completed; the responses are partial.', file);
+end
+
+m = memmapfile(file, 'Offset', header_size, 'Writable', writable, ...
+               'Format', {info.precision, dims.', 'h'});
@@ -0,0 +1,174 @@
+/*
+Program     : Room Impulse Response Generator - thread placement
+
+Description : The CPUs the process may run on and their NUMA nodes, read
+              from /sys/devices/system/node, and the pinning of the worker
+              threads to them for Config::affinity. On a machine with
+              several sockets a thread that adds images to a response on the
+              memory of another socket is limited by the link between them;
+              pinned threads stay on the node where the pages of their
+              responses were first touched. Without the node directory all
+              CPUs count as node 0; on other systems than Linux the threads
+              are not pinned.
+*/
+
+#ifndef RIR_NUMA_H
+#define RIR_NUMA_H
+
+#include "pthread.h"
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+
+#ifdef __linux__
+#include <sched.h>
+#define RIR_NUMA_PIN
+#define RIR_NUMA_MAX CPU_SETSIZE
+#else
+#define RIR_NUMA_MAX 1024
+#endif
+
+// Placement of the worker threads, as rir::Affinity
+#define RIR_AFFINITY_NONE       0
+#define RIR_AFFINITY_COMPACT    1
+#define RIR_AFFINITY_SCATTER    2
+
+struct rir_numa
+{
+	int     nr_of_cpus;                 // CPUs the process may run on, 0 = unknown
+	int     nr_of_nodes;                // nodes holding any of them
+	int     cpu[RIR_NUMA_MAX];          // the CPUs, node after node
+	int     node[RIR_NUMA_MAX];         // node of cpu[i]
+	int     node_first[RIR_NUMA_MAX];   // cpu[node_first[k]] is the first one of the k-th node
+	int     node_count[RIR_NUMA_MAX];
+#ifdef RIR_NUMA_PIN
+	cpu_set_t allowed;                  // of the calling thread, for unpinning
+#endif
+};
+
+// Sets in[i] for the CPUs or nodes of a list such as "0-3,8,10-11" in the
+// file path. Returns 0 when the file cannot be read.
+static int rir_numa_read_list(const char* path, unsigned char* in)
+{
+	FILE*   f = fopen(path, "r");
+	char    buf[4096];
+	char*   p = buf;
+
+	if (f == NULL)
+		return 0;
+	if (fgets(buf, sizeof(buf), f) == NULL)
+		buf[0] = 0;
+	fclose(f);
+
+	while (*p >= '0' && *p <= '9')
+	{
+		long lo = strtol(p, &p, 10);
+		long hi = lo;
+
+		if (*p == '-')
+			hi = strtol(p+1, &p, 10);
+		for (long i = lo ; i <= hi && i < RIR_NUMA_MAX ; i++)
+			in[i] = 1;
+		if (*p == ',')
+			p++;
+	}
+	return 1;
+}
+
+// Reads the CPUs of the calling thread and their nodes.
+static void rir_numa_load(struct rir_numa* t)
+{
+	unsigned char nodes[RIR_NUMA_MAX];
+	unsigned char cpus[RIR_NUMA_MAX];
+	int           node_of[RIR_NUMA_MAX];
+	char          path[64];
+
+	t->nr_of_cpus = 0;
+	t->nr_of_nodes = 0;
+#ifdef RIR_NUMA_PIN
+	if (sched_getaffinity(0, sizeof(t->allowed), &t->allowed) != 0)
+		return;
+
+	// Node 0 for all CPUs unless the nodes say otherwise
+	for (int c = 0 ; c < RIR_NUMA_MAX ; c++)
+		node_of[c] = 0;
+	memset(nodes, 0, sizeof(nodes));
+	if (rir_numa_read_list("/sys/devices/system/node/possible", nodes))
+	{
+		for (int n = 0 ; n < RIR_NUMA_MAX ; n++)
+		{
+			if (!nodes[n])
+				continue;
+			memset(cpus, 0, sizeof(cpus));
+			snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", n);
+			if (rir_numa_read_list(path, cpus))
+				for (int c = 0 ; c < RIR_NUMA_MAX ; c++)
+					if (cpus[c])
+						node_of[c] = n;
+		}
+	}
+
+	// The allowed CPUs grouped by node, in order of node and CPU number
+	for (int n = 0 ; n < RIR_NUMA_MAX ; n++)
+	{
+		int first = t->nr_of_cpus;
+
+		if (n > 0 && !nodes[n])
+			continue;
+		for (int c = 0 ; c < RIR_NUMA_MAX ; c++)
+			if (CPU_ISSET(c, &t->allowed) && node_of[c] == n)
+			{
+				t->cpu[t->nr_of_cpus] = c;
+				t->node[t->nr_of_cpus] = n;
+				t->nr_of_cpus++;
+			}
+		if (t->nr_of_cpus > first)
+		{
+			t->node_first[t->nr_of_nodes] = first;
+			t->node_count[t->nr_of_nodes] = t->nr_of_cpus - first;
+			t->nr_of_nodes++;
+		}
+	}
+#else
+	(void) nodes;
+	(void) cpus;
+	(void) node_of;
+	(void) path;
+#endif
+}
+
+// Index into t->cpu of worker thread i: compact fills one node after the
+// other, scatter takes the nodes in turn, so that fewer threads than CPUs use
+// the memory of every node. More threads than CPUs share them in the same
+// order.
+static int rir_numa_slot(const struct rir_numa* t, int affinity, int i)
+{
+	if (affinity == RIR_AFFINITY_SCATTER)
+	{
+		int k = i % t->nr_of_nodes;
+		return t->node_first[k] + (i / t->nr_of_nodes) % t->node_count[k];
+	}
+	return i % t->nr_of_cpus;
+}
+
+// Pins the thread to the CPU, or with cpu < 0 lets it run on all CPUs of
+// t again. Returns 0 on success.
+static int rir_numa_pin(const struct rir_numa* t, pthread_t thread, int cpu)
+{
+#ifdef RIR_NUMA_PIN
+	cpu_set_t set;
+
+	if (cpu < 0)
+		return pthread_setaffinity_np(thread, sizeof(t->allowed), &t->allowed);
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	return pthread_setaffinity_np(thread, sizeof(set), &set);
+#else
+	(void) t;
+	(void) thread;
+	(void) cpu;
+	return -1;
+#endif
+}
+
+#endif
@@ -0,0 +1,241 @@
+/*
+Program     : Room Impulse Response Generator - stochastic late reverberation
+
+Description : The late part of the responses for options.transition. The
+              images are only computed up to the transition; from there on
+              the response is Gaussian noise under the mean energy decay of
+              the image method. An image at distance r in direction u has
+              about r*|u_i|/L_i reflections on the walls of axis i, half on
+              each, so its energy relative to the direct path is
+                  prod_i |beta_i1*beta_i2|^(r*|u_i|/L_i),
+              and the number of images per distance grows as r^2 while their
+              energy falls as 1/r^2. The envelope is therefore the mean of
+              this product over the directions u. It is built once per room;
+              its level is fitted per response to the energy of the exact
+              part just before the transition.
+*/
+
+#ifndef RIR_TAIL_H
+#define RIR_TAIL_H
+
+#include "math.h"
+#include "stdlib.h"
+#include "stdint.h"
+
+// Directions per side of the octant grid and samples between the envelope
+// nodes
+#define RIR_TAIL_DIRS   32
+#define RIR_TAIL_STEP   32
+
+struct rir_tail
+{
+	int     start;          // first sample without images
+	int     window;         // samples per energy window of the fit
+	int     fade;           // samples over which the noise fades in around start
+	int     lo;             // first sample of env: start - fade/2 - 2*window
+	double* env;            // amplitude envelope for samples lo .. nsamples-1
+	size_t  bytes;          // memory held by the envelope
+};
+
+// Builds the envelope for responses of nsamples samples in a room of
+// dimensions L (in samples) with reflection coefficients beta.
+static void rir_tail_build(struct rir_tail* tail, unsigned int nsamples, int start, int window,
+	int fade, const double* L, const double* beta)
+{
+	double  k[3];
+	double  kd[RIR_TAIL_DIRS*RIR_TAIL_DIRS];
+	double  v[RIR_TAIL_DIRS*RIR_TAIL_DIRS];
+	double  f[RIR_TAIL_DIRS*RIR_TAIL_DIRS];
+	int     nr_of_dirs = RIR_TAIL_DIRS*RIR_TAIL_DIRS;
+	int     n_env;
+	int     n_nodes;
+	double* node;
+
+	tail->start = start;
+	tail->window = window;
+	tail->fade = fade;
+	tail->lo = start - fade/2 - 2*window;
+	n_env = (int)nsamples - tail->lo;
+	tail->env = new double[n_env];
+	tail->bytes = n_env*sizeof(double);
+
+	// Energy lost per sample of path along each axis
+	for (int i = 0 ; i < 3 ; i++)
+	{
+		double b = fabs(beta[2*i]*beta[2*i+1]);
+		k[i] = -log((b > 1e-300) ? b : 1e-300)/L[i];
+	}
+
+	// Directions of equal area in the first octant: u_z uniform, azimuth
+	// uniform
+	for (int a = 0 ; a < RIR_TAIL_DIRS ; a++)
+	{
+		double uz = (a + 0.5)/RIR_TAIL_DIRS;
+		double rho = sqrt(1 - uz*uz);
+		for (int c = 0 ; c < RIR_TAIL_DIRS ; c++)
+		{
+			double phi = (c + 0.5)*M_PI/(2*RIR_TAIL_DIRS);
+			int    d = a*RIR_TAIL_DIRS + c;
+			kd[d] = k[0]*rho*cos(phi) + k[1]*rho*sin(phi) + k[2]*uz;
+			v[d] = exp(-tail->lo*kd[d]);
+			f[d] = exp(-RIR_TAIL_STEP*kd[d]);
+		}
+	}
+
+	// Mean energy at the nodes lo + m*RIR_TAIL_STEP, amplitude in between
+	// interpolated linearly
+	n_nodes = (n_env + RIR_TAIL_STEP - 1)/RIR_TAIL_STEP + 1;
+	node = new double[n_nodes];
+	for (int m = 0 ; m < n_nodes ; m++)
+	{
+		double sum = 0;
+		for (int d = 0 ; d < nr_of_dirs ; d++)
+		{
+			sum += v[d];
+			v[d] *= f[d];
+		}
+		node[m] = sqrt(sum/nr_of_dirs);
+	}
+	for (int n = 0 ; n < n_env ; n++)
+	{
+		int    m = n/RIR_TAIL_STEP;
+		double w = (double)(n - m*RIR_TAIL_STEP)/RIR_TAIL_STEP;
+		tail->env[n] = node[m] + w*(node[m+1] - node[m]);
+	}
+	delete [] node;
+}
+
+static void rir_tail_free(struct rir_tail* tail)
+{
+	delete [] tail->env;
+}
+
+// Standard normal numbers from xorshift64* and Box-Muller, seeded per
+// response so that the tail does not depend on the threads.
+struct rir_tail_noise
+{
+	uint64_t state;
+	double   spare;
+	int      has_spare;
+};
+
+static void rir_tail_noise_init(struct rir_tail_noise* rng, uint64_t seed)
+{
+	// splitmix64 of the seed, never zero
+	uint64_t z = seed + 0x9E3779B97F4A7C15ull;
+	z = (z ^ (z >> 30))*0xBF58476D1CE4E5B9ull;
+	z = (z ^ (z >> 27))*0x94D049BB133111EBull;
+	rng->state = (z ^ (z >> 31)) | 1;
+	rng->has_spare = 0;
+}
+
+static double rir_tail_gauss(struct rir_tail_noise* rng)
+{
+	double u1, u2, r;
+
+	if (rng->has_spare)
+	{
+		rng->has_spare = 0;
+		return rng->spare;
+	}
+	rng->state ^= rng->state >> 12;
+	rng->state ^= rng->state << 25;
+	rng->state ^= rng->state >> 27;
+	u1 = ((rng->state*0x2545F4914F6CDD1Dull) >> 11)*(1.0/9007199254740992.0);
+	rng->state ^= rng->state >> 12;
+	rng->state ^= rng->state << 25;
+	rng->state ^= rng->state >> 27;
+	u2 = ((rng->state*0x2545F4914F6CDD1Dull) >> 11)*(1.0/9007199254740992.0);
+
+	r = sqrt(-2*log(1 - u1));
+	rng->spare = r*sin(2*M_PI*u2);
+	rng->has_spare = 1;
+	return r*cos(2*M_PI*u2);
+}
+
+// Level of the noise for a response whose exact part has the energies e1 in
+// the window just before the fade and e2 in the window before that. The
+// deviation in dB of e2 from the fitted envelope is stored in mismatch, as a
+// check that the field is already diffuse at the transition. The energies
+// are taken around the mean of each window: with positive reflection
+// coefficients all pulses are positive, and that offset is removed by the
+// high-pass filter but would not be in the noise.
+static double rir_tail_level(const struct rir_tail* tail, double e1, double e2, double* mismatch)
+{
+	double d1 = 0, d2 = 0;
+
+	for (int n = 0 ; n < tail->window ; n++)
+	{
+		d2 += tail->env[n]*tail->env[n];
+		d1 += tail->env[tail->window + n]*tail->env[tail->window + n];
+	}
+	*mismatch = 0;
+	if (e1 <= 0 || d1 <= 0)
+		return 0;
+	*mismatch = (e2 > 0) ? 10*log10(e2*d1/(e1*d2)) : -HUGE_VAL;
+	return sqrt(e1/d1);
+}
+
+// Adds the tail to the response h of nsamples samples. Returns the mismatch
+// of rir_tail_level.
+static double rir_tail_add(const struct rir_tail* tail, double* h, unsigned int nsamples, uint64_t seed)
+{
+	struct rir_tail_noise rng;
+	double e1 = 0, e2 = 0, m1 = 0, m2 = 0, mismatch, level;
+	int    n0 = tail->start - tail->fade/2;
+
+	for (int n = 0 ; n < tail->window ; n++)
+	{
+		m2 += h[tail->lo + n];
+		m1 += h[tail->lo + tail->window + n];
+	}
+	m2 /= tail->window;
+	m1 /= tail->window;
+	for (int n = 0 ; n < tail->window ; n++)
+	{
+		e2 += (h[tail->lo + n] - m2)*(h[tail->lo + n] - m2);
+		e1 += (h[tail->lo + tail->window + n] - m1)*(h[tail->lo + tail->window + n] - m1);
+	}
+	level = rir_tail_level(tail, e1, e2, &mismatch);
+
+	rir_tail_noise_init(&rng, seed);
+	for (int n = n0 ; n < (int)nsamples ; n++)
+	{
+		double w = (n - n0 < tail->fade) ? 0.5 - 0.5*cos(M_PI*(n - n0)/tail->fade) : 1;
+		h[n] += level*w*tail->env[n - tail->lo]*rir_tail_gauss(&rng);
+	}
+	return mismatch;
+}
+
+// Single precision version of rir_tail_add; the fit and the noise stay in
+// double.
+static double rir_tail_add_f(const struct rir_tail* tail, float* h, unsigned int nsamples, uint64_t seed)
+{
+	struct rir_tail_noise rng;
+	double e1 = 0, e2 = 0, m1 = 0, m2 = 0, mismatch, level;
+	int    n0 = tail->start - tail->fade/2;
+
+	for (int n = 0 ; n < tail->window ; n++)
+	{
+		m2 += h[tail->lo + n];
+		m1 += h[tail->lo + tail->window + n];
+	}
+	m2 /= tail->window;
+	m1 /= tail->window;
+	for (int n = 0 ; n < tail->window ; n++)
+	{
+		e2 += (h[tail->lo + n] - m2)*(h[tail->lo + n] - m2);
+		e1 += (h[tail->lo + tail->window + n] - m1)*(h[tail->lo + tail->window + n] - m1);
+	}
+	level = rir_tail_level(tail, e1, e2, &mismatch);
+
+	rir_tail_noise_init(&rng, seed);
+	for (int n = n0 ; n < (int)nsamples ; n++)
+	{
+		double w = (n - n0 < tail->fade) ? 0.5 - 0.5*cos(M_PI*(n - n0)/tail->fade) : 1;
+		h[n] += (float) (level*w*tail->env[n - tail->lo]*rir_tail_gauss(&rng));
+	}
+	return mismatch;
+}
+
+#endif